@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// Length-prefixed raw dumps of trivially copyable vectors, for cache files
+// that are only ever read back on the machine that wrote them.
+namespace BinaryIO {
+
+template <typename T>
+inline void writeVector(std::ostream &out, const std::vector<T> &v) {
+  uint64_t n = v.size();
+  out.write(reinterpret_cast<const char *>(&n), sizeof(n));
+  out.write(reinterpret_cast<const char *>(v.data()), n * sizeof(T));
+}
+
+// Bytes between the read position and the end of a seekable stream, or 0.
+inline uint64_t bytesLeft(std::istream &in) {
+  std::streampos here = in.tellg();
+  if (here < 0 || !in.seekg(0, std::ios::end))
+    return 0;
+  std::streampos end = in.tellg();
+  in.seekg(here);
+  return end > here ? uint64_t(end - here) : 0;
+}
+
+// Fails without allocating if the length prefix claims more elements than
+// the rest of the stream holds, so a damaged file cannot ask for gigabytes.
+template <typename T>
+inline bool readVector(std::istream &in, std::vector<T> &v) {
+  uint64_t n = 0;
+  if (!in.read(reinterpret_cast<char *>(&n), sizeof(n)) ||
+      n > bytesLeft(in) / sizeof(T))
+    return false;
+  v.resize(n);
+  return bool(in.read(reinterpret_cast<char *>(v.data()), n * sizeof(T)));
+}
+
+} // namespace BinaryIO
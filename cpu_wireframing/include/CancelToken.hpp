@@ -0,0 +1,29 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Cooperative cancellation of a frame in flight.
+ *
+ * The owner of a generation counter bumps it whenever the frame being
+ * drawn goes stale. A stage gets a token holding the generation it was
+ * started for and polls cancelled() between chunks of work, returning
+ * early (with its output in an unspecified state) once the two differ.
+ * A default-constructed token never cancels.
+ */
+class CancelToken {
+public:
+  CancelToken() = default;
+  CancelToken(const std::atomic<uint64_t> &generation, uint64_t started)
+      : generation_(&generation), started_(started) {}
+
+  bool cancelled() const {
+    return generation_ &&
+           generation_->load(std::memory_order_relaxed) != started_;
+  }
+
+private:
+  const std::atomic<uint64_t> *generation_ = nullptr;
+  uint64_t started_ = 0;
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "MiniGLM.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace CapsuleLine {
+
+// Pixels are evaluated and handed out in runs of at most this many.
+constexpr int kChunk = 64;
+
+/**
+ * @brief Intersects the x interval where a * x + b lies in [lo, hi] with
+ * [xlo, xhi].
+ */
+inline void clampLinear(float a, float b, float lo, float hi, float &xlo,
+                        float &xhi) {
+  if (std::fabs(a) < 1e-12f) {
+    if (b < lo || b > hi)
+      xhi = xlo - 1.0f;
+    return;
+  }
+  float e0 = (lo - b) / a, e1 = (hi - b) / a;
+  xlo = std::max(xlo, std::min(e0, e1));
+  xhi = std::min(xhi, std::max(e0, e1));
+}
+
+/**
+ * @brief Rasterizes a line of the given width as an anti-aliased capsule
+ * (a segment with round caps) and reports its coverage span by span.
+ *
+ * For every pixel row the capsule's x extent is found analytically, so only
+ * pixels with non-zero coverage are visited. Coverage is the clamped
+ * distance falloff width/2 + 0.5 - distance(pixel, segment), evaluated four
+ * pixels at a time with SSE2. The callback is invoked as
+ * span(y, x, count, coverage, t), where t holds the segment parameter of the
+ * closest point for each pixel (used to interpolate depth).
+ *
+ * @param p0 Start of the segment in (sub)pixel coordinates.
+ * @param p1 End of the segment in (sub)pixel coordinates.
+ * @param width Line width in pixels.
+ * @param clipW Viewport width; pixels outside [0, clipW) are never reported.
+ * @param clipH Viewport height; rows outside [0, clipH) are never reported.
+ */
+template <typename Span>
+inline void trace(const MiniGLM::vec2 &p0, const MiniGLM::vec2 &p1,
+                  float width, int clipW, int clipH, Span &&span) {
+  const float R = width * 0.5f + 0.5f;
+  const float dx = p1.x - p0.x, dy = p1.y - p0.y;
+  const float len2 = dx * dx + dy * dy;
+  const float invLen2 = len2 > 1e-12f ? 1.0f / len2 : 0.0f;
+  const float len = std::sqrt(len2);
+
+  float yTop = std::max(0.0f, std::ceil(std::min(p0.y, p1.y) - R));
+  float yBottom =
+      std::min(float(clipH - 1), std::floor(std::max(p0.y, p1.y) + R));
+  if (!(yTop <= yBottom))
+    return;
+
+  float cov[kChunk], tv[kChunk];
+  for (int y = int(yTop); y <= int(yBottom); ++y) {
+    const float fy = float(y);
+    float xlo = 1e30f, xhi = -1e30f;
+
+    // End caps.
+    for (const MiniGLM::vec2 &c : {p0, p1}) {
+      float h = R * R - (fy - c.y) * (fy - c.y);
+      if (h >= 0.0f) {
+        float s = std::sqrt(h);
+        xlo = std::min(xlo, c.x - s);
+        xhi = std::max(xhi, c.x + s);
+      }
+    }
+    // Body: within R of the infinite line and between the two caps.
+    if (len > 1e-6f) {
+      float blo = -1e30f, bhi = 1e30f;
+      float nx = -dy / len, ny = dx / len;
+      clampLinear(nx, ny * (fy - p0.y) - nx * p0.x, -R, R, blo, bhi);
+      clampLinear(dx, dy * (fy - p0.y) - dx * p0.x, 0.0f, len2, blo, bhi);
+      if (blo <= bhi) {
+        xlo = std::min(xlo, blo);
+        xhi = std::max(xhi, bhi);
+      }
+    }
+
+    xlo = std::max(0.0f, std::ceil(xlo));
+    xhi = std::min(float(clipW - 1), std::floor(xhi));
+    if (!(xlo <= xhi))
+      continue;
+
+    const float vy = fy - p0.y;
+    for (int x0 = int(xlo); x0 <= int(xhi); x0 += kChunk) {
+      int count = std::min(kChunk, int(xhi) - x0 + 1);
+      int i = 0;
+#if defined(__SSE2__)
+      const __m128 ramp = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+      const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+      const __m128 vdx = _mm_set1_ps(dx), vdy = _mm_set1_ps(dy);
+      const __m128 vvy = _mm_set1_ps(vy), vR = _mm_set1_ps(R);
+      const __m128 vInv = _mm_set1_ps(invLen2);
+      for (; i + 4 <= count; i += 4) {
+        __m128 vx = _mm_add_ps(_mm_set1_ps(float(x0 + i) - p0.x), ramp);
+        __m128 t = _mm_mul_ps(
+            _mm_add_ps(_mm_mul_ps(vx, vdx), _mm_mul_ps(vvy, vdy)), vInv);
+        t = _mm_min_ps(one, _mm_max_ps(zero, t));
+        __m128 ex = _mm_sub_ps(vx, _mm_mul_ps(t, vdx));
+        __m128 ey = _mm_sub_ps(vvy, _mm_mul_ps(t, vdy));
+        __m128 d =
+            _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)));
+        __m128 c = _mm_min_ps(one, _mm_max_ps(zero, _mm_sub_ps(vR, d)));
+        _mm_storeu_ps(cov + i, c);
+        _mm_storeu_ps(tv + i, t);
+      }
+#endif
+      for (; i < count; ++i) {
+        float vx = float(x0 + i) - p0.x;
+        float t = std::clamp((vx * dx + vy * dy) * invLen2, 0.0f, 1.0f);
+        float ex = vx - t * dx, ey = vy - t * dy;
+        float d = std::sqrt(ex * ex + ey * ey);
+        cov[i] = std::clamp(R - d, 0.0f, 1.0f);
+        tv[i] = t;
+      }
+      span(y, x0, count, cov, tv);
+    }
+  }
+}
+
+} // namespace CapsuleLine
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Clipper.hpp"
+#include "EdgeFilter.hpp"
+#include "MiniGLM.hpp"
+#include <cmath>
+#include <cstddef>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+// An edge that survived clipping, in pixel coordinates with screen-space
+// depth (0 = near, 1 = far).
+struct ScreenSegment {
+  MiniGLM::vec2 p0, p1;
+  float z0, z1;
+};
+
+// Pixel containing p. Floors rather than truncates, since guard-band
+// segments can extend to negative coordinates.
+inline MiniGLM::ivec2 toPixel(const MiniGLM::vec2 &p) {
+  return MiniGLM::ivec2(int(std::floor(p.x)), int(std::floor(p.y)));
+}
+
+// Per-frame counts of where edges left the pipeline.
+struct ClipStats {
+  size_t culled = 0;        // in clusters outside the frustum, never clipped
+  size_t occluded = 0;      // in clusters behind the OcclusionBuffer
+  size_t simplified = 0;    // merged away by a coarser EdgeLod level
+  size_t input = 0;         // edges handed to the stage
+  size_t filtered = 0;      // dropped by EdgeFilter (back-facing, no outline)
+  size_t trivialReject = 0; // both endpoints outside the same plane
+  size_t trivialAccept = 0; // both endpoints inside the (guard-band) frustum
+  size_t clipped = 0;       // straddled a plane and were clipped
+  size_t clippedAway = 0;   // straddled planes but had no visible part
+  size_t tooShort = 0;      // shorter than two pixels on screen
+  size_t duplicates = 0;    // removed by SegmentDedup
+  size_t emitted = 0;       // left in the segment stream
+
+  ClipStats &operator+=(const ClipStats &other);
+};
+
+std::ostream &operator<<(std::ostream &os, const ClipStats &stats);
+
+/**
+ * Clip stage between vertex transform and rasterization. Edges are processed
+ * four at a time: endpoints are gathered into SoA registers, outcodes and
+ * the trivial accept/reject masks are computed with SSE2, accepted lanes are
+ * projected to the viewport in the same registers, and only the lanes that
+ * straddle a plane take the scalar Liang-Barsky path. The result is a dense
+ * array of screen segments the rasterizer can walk without any clip tests.
+ *
+ * With a guard band g > 1, edges whose endpoints lie within g viewports of
+ * the center are accepted unclipped; their off-screen overhang is dropped by
+ * the rasterizer's per-span bounds clamp. Trivial rejection still uses the
+ * real viewport planes.
+ */
+class ClipStage {
+public:
+  ClipStage(int width, int height);
+
+  void setViewport(int width, int height);
+  void setGuardBand(float g) { clipper_.setGuardBand(g); }
+
+  // Appends the visible part of edges [begin, end) to out and adds the
+  // counts to stats. With filter set, edges it culls are dropped before
+  // clipping.
+  void run(const std::vector<MiniGLM::vec4> &clip,
+           const std::vector<std::pair<int, int>> &edges, size_t begin,
+           size_t end, std::vector<ScreenSegment> &out, ClipStats &stats,
+           const EdgeFilter *filter = nullptr) const;
+
+private:
+  int width_, height_;
+  Clipper clipper_;
+
+  void emit(const MiniGLM::vec4 &c0, const MiniGLM::vec4 &c1,
+            std::vector<ScreenSegment> &out, ClipStats &stats) const;
+  void clipOne(MiniGLM::vec4 c0, MiniGLM::vec4 c1,
+               std::vector<ScreenSegment> &out, ClipStats &stats) const;
+};
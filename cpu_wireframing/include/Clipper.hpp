@@ -9,12 +9,29 @@ public:
   // 3D clipping constructor (for near plane clipping)
   Clipper(float nearPlane);
 
+  // Clip-space frustum clipping constructor
+  Clipper();
+
   // Screen space line clipping (existing functionality)
   bool clipLine(MiniGLM::ivec2 &p0, MiniGLM::ivec2 &p1) const;
 
   // 3D line clipping against near plane in clip space
   bool clipLineNearPlane(MiniGLM::vec4 &p0, MiniGLM::vec4 &p1) const;
 
+  // Clip-space line clipping against all six frustum planes (-w <= x, y, z
+  // <= w), before the perspective divide
+  bool clipLineToFrustum(MiniGLM::vec4 &p0, MiniGLM::vec4 &p1) const;
+
+  // Widens the x/y frustum planes to -g*w <= x, y <= g*w; lines are then
+  // only clipped where they leave this guard band
+  void setGuardBand(float g) { guardBand_ = g; }
+  float guardBand() const { return guardBand_; }
+
+  // Bitmask of the frustum planes (x/y widened by guardBand) p lies outside
+  // of; 0 means inside
+  static int computeFrustumCode(const MiniGLM::vec4 &p,
+                                float guardBand = 1.0f);
+
 private:
   // Screen clipping bounds
   int xmin_, ymin_, xmax_, ymax_;
@@ -22,6 +39,9 @@ private:
   // Near plane distance (in clip space, this is w = nearPlane)
   float nearPlane_;
 
+  // Scale of the x/y frustum planes for clipLineToFrustum
+  float guardBand_ = 1.0f;
+
   // Screen clipping mode flag
   // bool useScreenClipping_;
 
@@ -33,6 +53,15 @@ private:
     TOP = 8     // 1000
   };
 
+  enum FrustumCode {
+    X_NEG = 1,
+    X_POS = 2,
+    Y_NEG = 4,
+    Y_POS = 8,
+    Z_NEG = 16,
+    Z_POS = 32
+  };
+
   int computeOutCode(int x, int y) const;
 
   // Linearly interpolate between two vec4 points
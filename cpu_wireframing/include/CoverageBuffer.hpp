@@ -0,0 +1,52 @@
+#pragma once
+
+#include "DepthBuffer.hpp"
+#include "MiniGLM.hpp"
+#include <cstdint>
+#include <vector>
+
+// How overlapping coverage is combined, both inside one buffer and when the
+// per-thread buffers are reduced into the framebuffer.
+enum class CoverageMerge { Max, SaturatingAdd };
+
+/**
+ * 8-bit alpha target owned by a single worker thread. All lines share one
+ * color, so coverage is all a worker needs to record; the color is applied
+ * once when the buffers are resolved into the Rasterizer.
+ */
+class CoverageBuffer {
+public:
+  CoverageBuffer(int width, int height,
+                 CoverageMerge merge = CoverageMerge::Max);
+
+  void clear();
+  // Changes the size, keeping the allocation if it is big enough; the
+  // buffer is empty afterwards.
+  void resize(int width, int height);
+
+  void drawLine(const MiniGLM::ivec2 &p0, const MiniGLM::ivec2 &p1);
+  void drawLine(const MiniGLM::ivec2 &p0, const MiniGLM::ivec2 &p1, float z0,
+                float z1, const DepthBuffer &depth);
+
+  void drawThickLine(const MiniGLM::vec2 &p0, const MiniGLM::vec2 &p1,
+                     float width, const DepthBuffer *depth = nullptr,
+                     float z0 = 0.0f, float z1 = 0.0f);
+
+  const uint8_t *row(int y) const { return alpha_.data() + y * width_; }
+
+  // Rows touched since the last clear(); empty when dirtyMinY() > dirtyMaxY().
+  int dirtyMinY() const { return dirtyMinY_; }
+  int dirtyMaxY() const { return dirtyMaxY_; }
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+private:
+  int width_, height_;
+  CoverageMerge merge_;
+  std::vector<uint8_t> alpha_;
+  int dirtyMinY_, dirtyMaxY_;
+
+  void plot(int x, int y, float intensity);
+  void markDirty(const MiniGLM::ivec2 &p0, const MiniGLM::ivec2 &p1);
+};
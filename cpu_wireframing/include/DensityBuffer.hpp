@@ -0,0 +1,48 @@
+#pragma once
+
+#include "DepthBuffer.hpp"
+#include "MiniGLM.hpp"
+#include <cstdint>
+#include <vector>
+
+/**
+ * Per-thread 16-bit line density accumulator. Each Wu sample adds its
+ * coverage (in 1/kUnitsPerHit steps) instead of blending, so pixels hit by
+ * dozens of edges keep counting rather than saturating to the line color.
+ * Rasterizer::resolveDensity sums the layers and tone-maps them to RGBA.
+ */
+class DensityBuffer {
+public:
+  static constexpr int kUnitsPerHit = 64;
+
+  DensityBuffer(int width, int height);
+
+  void clear();
+  // Changes the size, keeping the allocation if it is big enough; the
+  // buffer is empty afterwards.
+  void resize(int width, int height);
+
+  void drawLine(const MiniGLM::ivec2 &p0, const MiniGLM::ivec2 &p1);
+  void drawLine(const MiniGLM::ivec2 &p0, const MiniGLM::ivec2 &p1, float z0,
+                float z1, const DepthBuffer &depth);
+
+  void drawThickLine(const MiniGLM::vec2 &p0, const MiniGLM::vec2 &p1,
+                     float width, const DepthBuffer *depth = nullptr,
+                     float z0 = 0.0f, float z1 = 0.0f);
+
+  const uint16_t *row(int y) const { return counts_.data() + y * width_; }
+
+  int dirtyMinY() const { return dirtyMinY_; }
+  int dirtyMaxY() const { return dirtyMaxY_; }
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+private:
+  int width_, height_;
+  std::vector<uint16_t> counts_;
+  int dirtyMinY_, dirtyMaxY_;
+
+  void add(int x, int y, float intensity);
+  void markDirty(const MiniGLM::ivec2 &p0, const MiniGLM::ivec2 &p1);
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "CancelToken.hpp"
+#include "MiniGLM.hpp"
+#include "WuLine.hpp"
+#include <vector>
+
+/**
+ * Software depth buffer used for hidden-line removal. The mesh faces are
+ * rasterized into it first (screen-space depth, 0 = near, 1 = far), then line
+ * pixels are depth-tested against it. A per-tile max-depth pyramid level
+ * (hierarchical Z) rejects edges that are completely behind the surface
+ * before any of their pixels are visited.
+ */
+class DepthBuffer {
+public:
+  static constexpr int kTileSize = 8;
+  // Triangles between two cancellation checks.
+  static constexpr size_t kCancelInterval = 256;
+
+  /**
+   * @param constantBias Depth offset added to every face sample.
+   * @param slopeBias Offset scaled by the face's max screen-space depth
+   * slope, so edges lying on steep faces are not hidden by their own faces.
+   */
+  DepthBuffer(int width, int height, float constantBias = 1e-6f,
+              float slopeBias = 1.5f);
+
+  void clear();
+  // Changes the size, keeping the allocation if it is big enough, and
+  // clears.
+  void resize(int width, int height);
+
+  // triangles holds three vertex indices per triangle into clip. Once
+  // cancel fires the buffer is left half drawn and must be cleared.
+  void rasterize(const std::vector<MiniGLM::vec4> &clip,
+                 const std::vector<int> &triangles, float nearW,
+                 const CancelToken &cancel = CancelToken());
+
+  // Nearest face depth sampled at pixel (x, y), infinity where empty.
+  float depth(int x, int y) const { return depth_[size_t(y) * width_ + x]; }
+
+  bool visible(int x, int y, float z) const {
+    return x >= 0 && x < width_ && y >= 0 && y < height_ &&
+           z <= depth_[y * width_ + x];
+  }
+
+  bool segmentOccluded(const MiniGLM::ivec2 &p0, const MiniGLM::ivec2 &p1,
+                       float z0, float z1) const;
+
+  /**
+   * @brief Traces a Wu line like WuLine::trace but only hands visible pixels
+   * to plot. Depth is interpolated linearly along the major axis, which is
+   * exact because screen-space depth is affine in screen coordinates.
+   */
+  template <typename Plot>
+  void traceVisible(const MiniGLM::ivec2 &p0, const MiniGLM::ivec2 &p1,
+                    float z0, float z1, Plot &&plot) const {
+    if (segmentOccluded(p0, p1, z0, z1))
+      return;
+    bool steep = std::abs(p1.y - p0.y) > std::abs(p1.x - p0.x);
+    int m0 = steep ? p0.y : p0.x;
+    int span = (steep ? p1.y : p1.x) - m0;
+    float dz = span == 0 ? 0.0f : (z1 - z0) / float(span);
+    WuLine::trace(p0, p1, width_, height_,
+                  [&](int x, int y, float intensity) {
+                    float z = z0 + dz * float((steep ? y : x) - m0);
+                    if (visible(x, y, z))
+                      plot(x, y, intensity);
+                  });
+  }
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+private:
+  int width_, height_;
+  int tilesX_, tilesY_;
+  float constantBias_, slopeBias_;
+  std::vector<float> depth_;
+  std::vector<float> tileMax_;
+
+  struct Triangle {
+    float x[3], y[3], z[3];
+  };
+
+  void rasterizeTriangle(const Triangle &tri, int yBegin, int yEnd);
+  void buildHierarchy(int tileRowBegin, int tileRowEnd);
+};
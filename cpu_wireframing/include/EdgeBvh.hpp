@@ -0,0 +1,82 @@
+#pragma once
+
+#include "EdgeClusters.hpp"
+#include "MiniGLM.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Node of an EdgeBvh. Nodes are stored depth first: the left child of an
+// inner node directly follows it, rightChild gives the other one.
+struct BvhNode {
+  MiniGLM::vec3 boundsMin, boundsMax;
+  uint32_t firstCluster, clusterCount; // clusters below this node
+  uint32_t rightChild;                 // 0 for leaves
+};
+
+/**
+ * Bounding volume hierarchy over the edge clusters of a mesh.
+ *
+ * Leaves are single EdgeClusters in Morton order, so every node covers a
+ * contiguous run of clusters and inner nodes split their run at the median.
+ * The subtrees below the top levels are built on separate threads.
+ *
+ * Frustum culling walks the tree and emits a node's whole cluster run
+ * without further tests as soon as its box is fully inside the frustum.
+ * Picking walks it front to back against a pixel's neighbourhood to find
+ * the nearest edge under the cursor.
+ */
+class EdgeBvh {
+public:
+  EdgeBvh() = default;
+  EdgeBvh(const std::vector<MiniGLM::vec3> &vertices,
+          const std::vector<std::pair<int, int>> &edges);
+
+  /**
+   * @brief Loads the hierarchy from cachePath if the file was written for
+   * the same mesh, otherwise builds it and writes the file. An empty path
+   * disables the cache.
+   */
+  static EdgeBvh loadOrBuild(const std::vector<MiniGLM::vec3> &vertices,
+                             const std::vector<std::pair<int, int>> &edges,
+                             const std::string &cachePath);
+
+  bool save(const std::string &path, uint64_t meshHash) const;
+  // Fails, leaving the hierarchy unusable, unless the file matches the
+  // mesh and passes the range checks of EdgeClusters::read() and of the
+  // node layout.
+  bool load(const std::string &path, uint64_t meshHash,
+            size_t sourceEdgeCount);
+
+  // Fingerprint of the source mesh, stored in the cache file.
+  static uint64_t meshHash(const std::vector<MiniGLM::vec3> &vertices,
+                           const std::vector<std::pair<int, int>> &edges);
+
+  /**
+   * @brief Collects the clusters that may intersect the frustum of mvp.
+   *
+   * @return Number of edges in the culled clusters.
+   */
+  size_t cullFrustum(const MiniGLM::mat4 &mvp,
+                     std::vector<uint32_t> &visible) const;
+
+  /**
+   * @brief Finds the edge nearest to the viewer among those passing within
+   * radius pixels of pixel (px, py).
+   *
+   * @return Index into the edge list the hierarchy was built from, or -1.
+   */
+  long pickEdge(const MiniGLM::mat4 &mvp, int width, int height, float px,
+                float py, float radius = 4.0f) const;
+
+  const EdgeClusters &clusters() const { return clusters_; }
+  const std::vector<BvhNode> &nodes() const { return nodes_; }
+
+private:
+  EdgeClusters clusters_;
+  std::vector<BvhNode> nodes_;
+
+  void build();
+  void buildSubtree(uint32_t node, uint32_t first, uint32_t count);
+  bool validLayout() const;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "MiniGLM.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <utility>
+#include <vector>
+
+// A run of spatially close edges with the vertices they use.
+struct EdgeCluster {
+  MiniGLM::vec3 boundsMin, boundsMax;
+  uint32_t firstVertex, vertexCount; // range in EdgeClusters::vertices()
+  uint32_t firstEdge, edgeCount;     // range in EdgeClusters::edges()
+};
+
+/**
+ * Edges regrouped into spatially coherent clusters, the leaves of EdgeBvh.
+ *
+ * Edges are sorted along a Morton curve through their midpoints and cut into
+ * runs of clusterSize edges. Every cluster gets a bounding box and its own
+ * copy of the vertices it references, stored contiguously, so a visible
+ * cluster can be transformed and clipped without touching the rest of the
+ * mesh. Vertices shared by neighbouring clusters are duplicated.
+ */
+class EdgeClusters {
+public:
+  static constexpr size_t kDefaultClusterSize = 512;
+
+  EdgeClusters() = default;
+  EdgeClusters(const std::vector<MiniGLM::vec3> &vertices,
+               const std::vector<std::pair<int, int>> &edges,
+               size_t clusterSize = kDefaultClusterSize);
+
+  const std::vector<EdgeCluster> &clusters() const { return clusters_; }
+  const std::vector<MiniGLM::vec3> &vertices() const { return vertices_; }
+  // Endpoints index vertices(), inside the owning cluster's vertex range.
+  const std::vector<std::pair<int, int>> &edges() const { return edges_; }
+  // Index of edges()[i] in the edge list the clusters were built from.
+  uint32_t sourceEdge(size_t i) const { return sourceEdges_[i]; }
+
+  // Raw binary (de)serialization, used by the EdgeBvh cache file.
+  void write(std::ostream &out) const;
+  // read() fails unless every range and index in the file is in bounds
+  // and every source edge index is below sourceEdgeCount.
+  bool read(std::istream &in, size_t sourceEdgeCount);
+
+private:
+  std::vector<EdgeCluster> clusters_;
+  std::vector<MiniGLM::vec3> vertices_;
+  std::vector<std::pair<int, int>> edges_;
+  std::vector<uint32_t> sourceEdges_;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "EdgeClusters.hpp"
+#include "MiniGLM.hpp"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * Per-frame edge selection from the orientation of the adjacent faces.
+ *
+ * Face planes are kept in SoA arrays padded to a multiple of four, so
+ * classifying every face against the camera is a parallel SSE2 sweep of
+ * four-wide dot products. Each edge knows its two adjacent faces (in
+ * EdgeClusters order); from their flags an edge is
+ *  - back-facing when both faces are turned away, and
+ *  - a silhouette when exactly one of them is.
+ *
+ * In outline mode only silhouettes and feature edges survive. Feature
+ * edges are fixed at load: creases whose dihedral angle exceeds the
+ * threshold, boundaries, and edges without usable adjacency. The latter
+ * point at a sentinel face that always faces the camera.
+ */
+class EdgeFilter {
+public:
+  EdgeFilter(const std::vector<MiniGLM::vec4> &facePlanes,
+             const std::vector<std::pair<int, int>> &edgeFaces,
+             const EdgeClusters &clusters);
+
+  // Drop edges whose adjacent faces all face away from the camera.
+  void setCullBackfaces(bool enabled) { cullBackfaces_ = enabled; }
+  // Keep only silhouettes and feature edges, with creases being edges
+  // whose face normals differ by more than creaseDegrees.
+  void setOutlineOnly(bool enabled, float creaseDegrees = 30.0f);
+
+  // Classifies all faces against eye, a homogeneous model-space camera
+  // position as given by VertexProcessor::eyePosition().
+  void update(const MiniGLM::vec4 &eye);
+
+  // Whether clusters.edges()[i] is dropped for the camera of the last
+  // update().
+  bool culled(size_t i) const {
+    uint8_t b0 = back_[edgeFaces_[i].first];
+    uint8_t b1 = back_[edgeFaces_[i].second];
+    return ((b0 & b1) & cullBackfaces_) |
+           (outlineOnly_ & !((b0 ^ b1) | feature_[i]));
+  }
+
+private:
+  size_t faceCount_;
+  std::vector<float> nx_, ny_, nz_, d_;
+  // One flag per face plus the always-front sentinel at faceCount_.
+  std::vector<uint8_t> back_;
+  std::vector<std::pair<uint32_t, uint32_t>> edgeFaces_;
+  // Per edge: crease, boundary or non-manifold (outline mode only).
+  std::vector<uint8_t> feature_;
+  bool cullBackfaces_ = false;
+  bool outlineOnly_ = false;
+};
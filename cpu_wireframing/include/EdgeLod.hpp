@@ -0,0 +1,58 @@
+#pragma once
+
+#include "EdgeClusters.hpp"
+#include "MiniGLM.hpp"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// One simplified version of an EdgeCluster.
+struct LodLevel {
+  uint32_t firstVertex, vertexCount; // range in EdgeLod::vertices()
+  uint32_t firstEdge, edgeCount;     // range in EdgeLod::edges()
+};
+
+/**
+ * Coarser versions of every edge cluster for distant or dense views.
+ *
+ * Level k (1..kLevels) snaps the cluster's vertices to the centers of a
+ * uniform grid whose cells are 2^k times the mean edge length, drops edges
+ * that collapse into one cell and merges duplicates. The grid is global, so
+ * neighbouring clusters snap shared vertices to the same point and no gaps
+ * open between them. At render time each visible cluster is drawn at the
+ * coarsest level whose cells still project to at most maxError pixels, so
+ * sub-pixel detail is gone before any vertex is transformed.
+ */
+class EdgeLod {
+public:
+  static constexpr int kLevels = 5;
+
+  EdgeLod() = default;
+  explicit EdgeLod(const EdgeClusters &clusters);
+
+  bool empty() const { return levels_.empty(); }
+
+  // Edge length of grid cells at level (level >= 1).
+  float cellSize(int level) const { return baseCell_ * float(1 << level); }
+
+  /**
+   * @brief Coarsest level whose cells cover at most maxError pixels
+   * anywhere in the cluster's box; 0 means the full-detail cluster. The
+   * default matches ClipStage, which drops segments under two pixels.
+   */
+  int selectLevel(const MiniGLM::mat4 &mvp, int width, int height,
+                  const EdgeCluster &cluster, float maxError = 2.0f) const;
+
+  const LodLevel &level(size_t cluster, int level) const {
+    return levels_[cluster * kLevels + size_t(level - 1)];
+  }
+  const std::vector<MiniGLM::vec3> &vertices() const { return vertices_; }
+  // Endpoints index vertices(), inside the owning level's vertex range.
+  const std::vector<std::pair<int, int>> &edges() const { return edges_; }
+
+private:
+  float baseCell_ = 0.0f;
+  std::vector<LodLevel> levels_; // kLevels per cluster
+  std::vector<MiniGLM::vec3> vertices_;
+  std::vector<std::pair<int, int>> edges_;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Gamma {
+
+// Linear intensities are 8.8 fixed point: 0 .. 255 << 8.
+constexpr int kLinearShift = 8;
+// The encode table is indexed by linear >> kEncodeShift (4096 entries), fine
+// enough that dark gradients do not band.
+constexpr int kEncodeShift = 4;
+
+struct Tables {
+  uint16_t toLinear[256];
+  uint8_t toSrgb[(255 << kLinearShift >> kEncodeShift) + 1];
+};
+
+const Tables &tables();
+
+} // namespace Gamma
@@ -14,12 +14,24 @@ public:
   std::vector<MiniGLM::vec3> vertices;
   std::vector<Face> faces;
   std::vector<std::pair<int, int>> edges;
+  // The faces on either side of edges[i]. A boundary edge repeats its only
+  // face; an edge shared by more than two faces has -1 on both sides.
+  std::vector<std::pair<int, int>> edgeFaces;
+  // Per face: unit normal (counter-clockwise winding) and plane offset, so
+  // dot(plane, vec4(p, 1)) is the signed distance of p to the face.
+  std::vector<MiniGLM::vec4> facePlanes;
 
   bool load(const std::string &filename);
 
+  std::vector<int> triangulateFaces() const;
+
 private:
-  bool validate_vertex(const std::vector<std::string> tokens);
-  bool validate_face(const std::vector<std::string> tokens);
-  bool is_valid_face_indices(const std::vector<int> &indices);
+  struct ParsedBlock;
+
+  void parse_lines(const std::string &text, size_t begin, size_t end,
+                   ParsedBlock &out) const;
+  bool validate_vertex(const std::vector<std::string> tokens) const;
+  bool validate_face(const std::vector<std::string> tokens) const;
   void extract_edges();
+  void compute_face_planes();
 };
\ No newline at end of file
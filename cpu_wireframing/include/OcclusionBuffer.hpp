@@ -0,0 +1,71 @@
+#pragma once
+
+#include "EdgeClusters.hpp"
+#include "MiniGLM.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Low-resolution depth buffer of a few large occluders, rendered every frame
+ * to skip edge clusters hidden behind them.
+ *
+ * Coplanar triangle pairs forming a convex quad are merged at construction,
+ * and the resulting polygons are rasterized inner-conservatively into
+ * kWidth x kHeight cells: a polygon only writes a cell it covers completely,
+ * and then writes its farthest depth over the cell, which is found at a
+ * cell corner since the polygon is planar. Gaps between occluders therefore
+ * stay open however narrow they are. A cluster is skipped when each cell
+ * under its projected box holds an occluder nearer than the box's nearest
+ * corner.
+ */
+class OcclusionBuffer {
+public:
+  static constexpr int kWidth = 256;
+  static constexpr int kHeight = 128;
+  static constexpr size_t kDefaultOccluders = 2048;
+
+  // triangles holds three indices into vertices per occluder triangle.
+  OcclusionBuffer(const std::vector<MiniGLM::vec3> &vertices,
+                  const std::vector<int> &triangles);
+
+  // Occluders made of the count largest triangles of a mesh.
+  static std::unique_ptr<OcclusionBuffer>
+  largestFaces(const std::vector<MiniGLM::vec3> &vertices,
+               const std::vector<int> &triangles,
+               size_t count = kDefaultOccluders);
+  // Occluders loaded from an OBJ file, or nullptr if it cannot be read.
+  static std::unique_ptr<OcclusionBuffer> load(const std::string &path);
+
+  // Transforms and rasterizes the occluders for this frame.
+  void render(const MiniGLM::mat4 &mvp);
+
+  // Whether the box lies entirely behind the occluders of the last render.
+  bool occluded(const MiniGLM::mat4 &mvp, const MiniGLM::vec3 &boundsMin,
+                const MiniGLM::vec3 &boundsMax) const;
+
+  /**
+   * @brief Removes the occluded clusters from visible.
+   *
+   * @return Number of edges in the removed clusters.
+   */
+  size_t cull(const MiniGLM::mat4 &mvp, const EdgeClusters &clusters,
+              std::vector<uint32_t> &visible) const;
+
+private:
+  static constexpr float kNearW = 1e-3f;
+  // Pushes occluders back a little so edges lying on an occluder face
+  // never lose to rounding.
+  static constexpr float kDepthBias = 1e-5f;
+
+  std::vector<MiniGLM::vec3> vertices_;
+  // Four vertex indices per convex planar polygon, the last -1 for
+  // triangles.
+  std::vector<int> polygons_;
+  std::vector<MiniGLM::vec4> clip_;
+  // Per cell: nearest of the farthest depths of the occluders covering it.
+  std::vector<float> cellFar_;
+
+  void mergeQuads(const std::vector<int> &triangles);
+  void rasterizeCells(const MiniGLM::vec4 *corners, int count);
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace Parallel {
+
+// Participants of the shared pool, the calling thread included.
+inline size_t threadCount() { return ThreadPool::shared().size(); }
+
+/**
+ * @brief Runs fn(begin, end, worker) over [0, count) in chunks of grain
+ * items on the shared pool and returns when all of them are done.
+ *
+ * Idle workers steal chunks, so grain can be well below count / threads
+ * when the cost per item varies.
+ */
+template <typename Fn>
+inline void parallelFor(size_t count, size_t grain, Fn &&fn) {
+  ThreadPool::shared().forkJoin(count, grain, ThreadPool::Chunk(std::ref(fn)));
+}
+
+/**
+ * @brief Splits [0, count) into `chunks` contiguous ranges and runs
+ * fn(begin, end, chunk) for each of them on the shared pool.
+ *
+ * The chunk index lets callers give every range a private output slot.
+ */
+template <typename Fn>
+inline void forEachChunk(size_t count, size_t chunks, Fn &&fn) {
+  chunks = std::max<size_t>(1, std::min(chunks, count));
+  const size_t perChunk = count / chunks;
+  parallelFor(chunks, 1, [&](size_t first, size_t last, size_t) {
+    for (size_t c = first; c < last; ++c) {
+      size_t begin = c * perChunk;
+      size_t end = (c + 1 == chunks) ? count : begin + perChunk;
+      fn(begin, end, c);
+    }
+  });
+}
+
+/**
+ * @brief Sorts [first, last): every participant sorts a slice, then
+ * neighbouring slices are merged pairwise. Not stable.
+ */
+template <typename It, typename Less = std::less<>>
+inline void sort(It first, It last, Less less = Less()) {
+  const size_t count = size_t(last - first);
+  const size_t chunks = std::max<size_t>(1, std::min(threadCount(), count));
+  std::vector<size_t> bounds(chunks + 1, count);
+  forEachChunk(count, chunks, [&](size_t begin, size_t end, size_t chunk) {
+    bounds[chunk] = begin;
+    std::sort(first + begin, first + end, less);
+  });
+  for (size_t width = 1; width < chunks; width *= 2) {
+    forEachChunk((chunks + 2 * width - 1) / (2 * width), chunks,
+                 [&](size_t begin, size_t end, size_t) {
+                   for (size_t m = begin; m < end; ++m) {
+                     size_t a = m * 2 * width, b = std::min(chunks, a + width);
+                     size_t c = std::min(chunks, a + 2 * width);
+                     std::inplace_merge(first + bounds[a], first + bounds[b],
+                                        first + bounds[c], less);
+                   }
+                 });
+  }
+}
+
+} // namespace Parallel
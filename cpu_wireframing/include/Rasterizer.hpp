@@ -1,6 +1,10 @@
 #pragma once
 
+#include "CoverageBuffer.hpp"
+#include "DensityBuffer.hpp"
+#include "DepthBuffer.hpp"
 #include "MiniGLM.hpp"
+#include <limits>
 #include <vector>
 
 struct Color {
@@ -14,13 +18,43 @@ class Rasterizer {
 public:
   Rasterizer(int width, int height);
 
+  // Changes the size without giving memory back; contents are undefined
+  // until the next clear().
+  void resize(int width, int height);
+
   void clear(const Color &color);
 
+  // Blend in linear light instead of sRGB byte space.
+  void setGammaCorrect(bool enabled) { gamma_ = enabled; }
+  bool gammaCorrect() const { return gamma_; }
+
   void drawLine(const MiniGLM::ivec2 &p0, const MiniGLM::ivec2 &p1,
                 const Color &color);
 
+  void drawLine(const MiniGLM::ivec2 &p0, const MiniGLM::ivec2 &p1, float z0,
+                float z1, const Color &color, const DepthBuffer &depth);
+
+  // One-pixel line without anti-aliasing, each pixel a plain store; the
+  // fast path of interactive frames. Only rows [rowBegin, rowEnd) are
+  // written, so threads owning disjoint row bands can share the buffer.
+  void drawLineAliased(const MiniGLM::ivec2 &p0, const MiniGLM::ivec2 &p1,
+                       const Color &color, const DepthBuffer *depth = nullptr,
+                       float z0 = 0.0f, float z1 = 0.0f, int rowBegin = 0,
+                       int rowEnd = std::numeric_limits<int>::max());
+
+  void drawThickLine(const MiniGLM::vec2 &p0, const MiniGLM::vec2 &p1,
+                     float width, const Color &color,
+                     const DepthBuffer *depth = nullptr, float z0 = 0.0f,
+                     float z1 = 0.0f);
+
   void plotAA(int x, int y, const Color &color, float intensity);
 
+  void resolveCoverage(const std::vector<CoverageBuffer> &layers,
+                       const Color &color, CoverageMerge merge);
+
+  void resolveDensity(const std::vector<DensityBuffer> &layers,
+                      const Color &color);
+
   const std::vector<Color> &getBuffer() const { return buffer_; }
 
   int width() const { return width_; }
@@ -29,6 +63,10 @@ public:
 private:
   int width_, height_;
   std::vector<Color> buffer_;
+  std::vector<uint32_t> densityTotal_;
+  bool gamma_ = false;
 
   void setPixel(int x, int y, const Color &color);
+  void blendSpan(Color *dest, const uint8_t *alpha, int n,
+                 const Color &color) const;
 };
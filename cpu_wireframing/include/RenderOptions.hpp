@@ -0,0 +1,67 @@
+#pragma once
+
+#include "CoverageBuffer.hpp"
+#include "ThreadPool.hpp"
+#include <cstddef>
+#include <string>
+
+// The binary parsing the options; flags for the other one are rejected.
+enum class RenderProgram { Gui, File };
+
+// Where worker threads write their lines.
+enum class RasterMode {
+  Shared,         // every worker blends straight into Rasterizer's buffer
+  PrivateCoverage, // each worker owns a CoverageBuffer, merged at frame end
+  Density          // each worker accumulates a DensityBuffer, tone-mapped
+};
+
+/**
+ * Optional rendering switches shared by render-gui and render-to-file. They
+ * are given as trailing "--flag [value]" arguments after the positional ones.
+ * The thread pool settings can also come from the environment.
+ */
+struct RenderOptions {
+  RasterMode rasterMode = RasterMode::Shared;
+  CoverageMerge coverageMerge = CoverageMerge::Max;
+  bool hiddenLine = false;
+  // Drop edges whose adjacent faces all face away from the camera.
+  bool cullBackfaces = false;
+  // Draw only silhouettes and creases sharper than creaseAngle degrees.
+  bool outlineOnly = false;
+  float creaseAngle = 30.0f;
+  // Draw clusters at the coarsest EdgeLod level with sub-pixel cells.
+  bool lod = false;
+  // Draw segments that snap to the same quarter pixels only once.
+  bool dedup = false;
+  // Skip clusters hidden behind the largest faces, or behind the faces of
+  // occluderFile if set.
+  bool occlusionCulling = false;
+  std::string occluderFile;
+  float depthBias = 1e-6f;
+  float lineWidth = 1.0f;
+  // Edges within this many viewports of the center skip x/y clipping.
+  float guardBand = 1.0f;
+  bool gammaCorrect = false;
+  // Largest fraction of the window size the GUI renders at while the view
+  // is being dragged or zoomed (lowered further to keep frames at 16 ms).
+  float interactiveScale = 0.5f;
+  // Size and placement of the shared thread pool.
+  ThreadPoolOptions pool;
+  bool printStats = false;
+  // EdgeBvh cache file; empty to always build at load.
+  std::string bvhCache;
+  // Pixel to pick the nearest edge at (render-to-file).
+  bool pick = false;
+  float pickX = 0.0f, pickY = 0.0f;
+  // Output size of render-to-file.
+  int width = 1000;
+  int height = 1000;
+  // Frames render-to-file draws while the eye orbits the Y axis; the
+  // geometry of each frame is built while the previous one rasterizes.
+  int orbitFrames = 1;
+};
+
+bool parseRenderOptions(int argc, char **argv, int first,
+                        RenderOptions &options, RenderProgram program);
+
+std::string renderOptionsUsage(RenderProgram program);
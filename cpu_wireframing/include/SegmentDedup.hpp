@@ -0,0 +1,33 @@
+#pragma once
+
+#include "ClipStage.hpp"
+#include <cstdint>
+#include <vector>
+
+/**
+ * Removes screen segments that land on the same place as an earlier one.
+ *
+ * Endpoints are snapped to a 1/4 pixel grid and put in a canonical order,
+ * then looked up in an open-addressing hash table of snapped segments.
+ * Zoomed-out views of dense meshes project many edges onto the same few
+ * pixels; only the first of each group is kept, with the nearest depth of
+ * the group at each end so hidden-line tests never get stricter. The table
+ * is kept between frames and only grows.
+ */
+class SegmentDedup {
+public:
+  static constexpr int kSubpixelBits = 2;
+
+  // Compacts segments in place (first occurrences keep their order) and
+  // moves the removed ones from stats.emitted to stats.duplicates.
+  void run(std::vector<ScreenSegment> &segments, ClipStats &stats);
+
+private:
+  struct Slot {
+    int32_t x0, y0, x1, y1;
+    uint32_t index; // kEmpty if unused
+  };
+  static constexpr uint32_t kEmpty = ~uint32_t(0);
+
+  std::vector<Slot> table_;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "ThreadPool.hpp"
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/**
+ * Tasks with dependencies, run on a ThreadPool.
+ *
+ * A task may only depend on tasks added before it, so the graph is acyclic
+ * by construction. Tasks whose dependencies are done run as one forkJoin;
+ * the thread finishing the last dependency of others forks those in turn,
+ * so independent stages overlap and the parallel loops inside a task
+ * spread over whichever workers the other tasks leave idle.
+ */
+class TaskGraph {
+public:
+  using Task = size_t;
+
+  // Adds fn to run after every task in `after`.
+  Task add(std::function<void()> fn, const std::vector<Task> &after = {});
+
+  // Runs every task once and returns when all are done. The graph can be
+  // run again.
+  void run(ThreadPool &pool = ThreadPool::shared()) const;
+
+  size_t size() const { return nodes_.size(); }
+
+private:
+  struct Node {
+    std::function<void()> fn;
+    std::vector<Task> dependents;
+    size_t dependencies = 0;
+  };
+  std::vector<Node> nodes_;
+
+  void runReady(ThreadPool &pool, const std::vector<Task> &ready,
+                std::atomic<size_t> *pending) const;
+};
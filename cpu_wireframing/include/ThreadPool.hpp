@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Where pool threads run.
+enum class ThreadPinning {
+  None, // wherever the scheduler puts them
+  Cores // one per physical core first, then on the SMT siblings
+};
+
+// Placement of a pool's threads, given on the command line or through the
+// environment.
+struct ThreadPoolOptions {
+  // Participants, the calling thread included; 0 for one per CPU the
+  // process may run on.
+  size_t threads = 0;
+  ThreadPinning pinning = ThreadPinning::None;
+  // Scheduling niceness of the pool threads (-20..19); the calling thread
+  // keeps its own.
+  int niceness = 0;
+};
+
+/**
+ * Work-stealing fork-join pool whose calling thread takes part in the work.
+ *
+ * forkJoin() cuts [0, count) into chunks of `grain` items and deals them
+ * out in contiguous runs to one deque per participant: workers
+ * 1..size()-1 are pool threads, worker 0 stands for any other thread.
+ * Pool threads pop from the front of their own deque and, once that is
+ * empty, steal from the back of the others, so a slow chunk only delays
+ * the thread running it. The caller works through chunks of its own call
+ * and then blocks on a latch until the stolen ones are done.
+ *
+ * forkJoin() may be issued from several threads at once and from inside a
+ * chunk; a nested call spreads over whichever workers are idle. A thread
+ * waiting in forkJoin() only runs chunks of its own call, so the worker
+ * index is unique among the chunks of one call running at the same time
+ * and never re-enters a slot its thread is already using.
+ */
+class ThreadPool {
+public:
+  using Chunk = std::function<void(size_t begin, size_t end, size_t worker)>;
+
+  // Time one participant spent running chunks, and how many it ran. A
+  // pool thread that got much less CPU time than it was busy for was
+  // waiting for a core, which means the machine is oversubscribed.
+  struct WorkerLoad {
+    double busySeconds;
+    double cpuSeconds; // CPU time of the thread; -1 if unknown
+    uint64_t chunks;
+    int cpu; // pinned CPU, or -1
+  };
+
+  // threads counts all participants, the calling thread included.
+  explicit ThreadPool(size_t threads);
+  explicit ThreadPool(const ThreadPoolOptions &options);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t size() const { return queues_.size(); }
+
+  // Runs fn(begin, end, worker) over [0, count) and returns when all chunks
+  // are done. worker < size() identifies the executing participant.
+  void forkJoin(size_t count, size_t grain, const Chunk &fn);
+
+  std::vector<WorkerLoad> load() const;
+  double uptimeSeconds() const;
+
+  // The pool every stage of the renderer shares, started on first use.
+  static ThreadPool &shared();
+  // Configures shared(). Only has an effect before the first shared()
+  // call, and returns false after it.
+  static bool setSharedOptions(const ThreadPoolOptions &options);
+  // CPUs this process may run on.
+  static size_t hardwareThreads();
+
+private:
+  // One forkJoin() call; lives on the caller's stack.
+  struct Job {
+    const Chunk *fn;
+    std::atomic<size_t> remaining{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+  };
+  struct Range {
+    Job *job;
+    size_t begin, end;
+  };
+  struct alignas(64) Queue {
+    std::mutex mutex;
+    std::deque<Range> ranges;
+    // Utilization of the participant owning this deque.
+    std::atomic<uint64_t> busyNanos{0};
+    std::atomic<uint64_t> chunks{0};
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+  // CPU of each participant with ThreadPinning::Cores (worker 0's is left
+  // to the calling threads), else empty.
+  std::vector<int> cpus_;
+  int niceness_ = 0;
+  std::chrono::steady_clock::time_point started_;
+
+  std::mutex wakeMutex_;
+  std::condition_variable wakeCv_;
+  size_t generation_ = 0;
+  bool quit_ = false;
+
+  void placeWorker(size_t worker) const;
+  void workerLoop(size_t worker);
+  bool take(size_t worker, const Job *job, Range &range);
+  void run(const Range &range, size_t worker);
+  static std::chrono::steady_clock::time_point beginRun();
+  void endRun(size_t worker, std::chrono::steady_clock::time_point start,
+              size_t chunks);
+};
+
+// One line per participant with its share of the pool's lifetime spent
+// running chunks.
+std::ostream &operator<<(std::ostream &os, const ThreadPool &pool);
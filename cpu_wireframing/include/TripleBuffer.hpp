@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lock-free handoff of the newest value from one writer thread to one
+ * reader thread.
+ *
+ * Three slots rotate between the roles "being written", "being read" and
+ * "latest published". The writer fills writeSlot() and swaps it with the
+ * published slot; the reader swaps the published slot into its own role
+ * if anything new arrived. Neither side ever waits for the other, a slot
+ * is never touched by both at once, and values published faster than the
+ * reader looks are simply replaced.
+ */
+template <typename T> class TripleBuffer {
+public:
+  // The writer's slot, free to fill until publish().
+  T &writeSlot() { return slots_[write_]; }
+
+  // Makes writeSlot() the latest value and hands the writer another slot.
+  void publish() {
+    write_ = middle_.exchange(uint8_t(write_ | kFresh)) & kIndex;
+  }
+
+  // Takes over the latest value if one was published since the last call;
+  // returns false (and keeps the previous slot) otherwise.
+  bool acquire() {
+    if (!(middle_.load() & kFresh))
+      return false;
+    read_ = middle_.exchange(read_) & kIndex;
+    return true;
+  }
+
+  // The reader's slot, stable until the next acquire().
+  const T &readSlot() const { return slots_[read_]; }
+
+private:
+  static constexpr uint8_t kIndex = 3, kFresh = 4;
+
+  T slots_[3];
+  uint8_t write_ = 0, read_ = 1;
+  std::atomic<uint8_t> middle_{2};
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "CancelToken.hpp"
 #include "MiniGLM.hpp"
 #include <vector>
 
@@ -12,8 +13,25 @@ public:
   void setViewMatrix(const MiniGLM::mat4 &view);
   void setProjectionMatrix(const MiniGLM::mat4 &projection);
 
+  // Chunks left when cancel fires stay zero.
   std::vector<MiniGLM::vec4>
-  transformVertices(const std::vector<MiniGLM::vec3> &vertices) const;
+  transformVertices(const std::vector<MiniGLM::vec3> &vertices,
+                    const CancelToken &cancel = CancelToken()) const;
+
+  // Transforms vertices [begin, end) into the same slots of out on the
+  // calling thread; out must already hold at least end entries.
+  void transformRange(const std::vector<MiniGLM::vec3> &vertices,
+                      size_t begin, size_t end,
+                      std::vector<MiniGLM::vec4> &out) const;
+
+  MiniGLM::mat4 modelViewProjection() const {
+    return projection_ * view_ * model_;
+  }
+
+  // Center of projection in model space, homogeneous: w = 1 for a
+  // perspective camera, w = 0 (the direction towards the viewer) for an
+  // orthographic one.
+  MiniGLM::vec4 eyePosition() const;
 
 private:
   MiniGLM::mat4 model_;
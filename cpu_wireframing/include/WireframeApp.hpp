@@ -1,17 +1,29 @@
 #pragma once
 
-#include <Clipper.hpp>
+#include <CancelToken.hpp>
+#include <ClipStage.hpp>
+#include <EdgeBvh.hpp>
+#include <EdgeFilter.hpp>
+#include <EdgeLod.hpp>
 #include <MiniGLM.hpp>
+#include <OcclusionBuffer.hpp>
+#include <Parallel.hpp>
 #include <QImage>
 #include <QPoint>
 #include <QResizeEvent>
+#include <QTimer>
 #include <QWidget>
 #include <Rasterizer.hpp>
+#include <RenderOptions.hpp>
+#include <SegmentDedup.hpp>
+#include <ThreadPool.hpp>
+#include <TripleBuffer.hpp>
 #include <VertexProcessor.hpp>
 #include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
 
 class WireframeApp : public QWidget {
@@ -19,11 +31,14 @@ class WireframeApp : public QWidget {
 public:
   explicit WireframeApp(const std::vector<MiniGLM::vec3> &vertices,
                         const std::vector<std::pair<int, int>> &edges,
-                        int width, int height, QWidget *parent = nullptr);
+                        const std::vector<int> &triangles,
+                        const std::vector<MiniGLM::vec4> &facePlanes,
+                        const std::vector<std::pair<int, int>> &edgeFaces,
+                        int width, int height,
+                        const RenderOptions &options = RenderOptions(),
+                        QWidget *parent = nullptr);
   ~WireframeApp();
 
-  void updateFrameBuffer(const uchar *data, int dataSize);
-
 protected:
   void paintEvent(QPaintEvent *event) override;
   void resizeEvent(QResizeEvent *event) override;
@@ -34,49 +49,145 @@ protected:
   void mouseReleaseEvent(QMouseEvent *event) override;
 
 private:
+  // Window size as seen by the GUI thread.
   int m_width;
   int m_height;
-  uchar *m_frameBuffer;
-  QImage *m_image;
   MiniGLM::vec3 center;
   MiniGLM::vec3 eye;
   MiniGLM::mat4 model, view, proj;
 
   bool rotating_ = false;
   QPoint lastMousePos_;
+  QPoint pressPos_;
   float yaw_ = 0.0f, pitch_ = 0.0f;
   float cam_dist_ = 2.5f;
 
+  static constexpr float kNearW = 0.01f;
+
+  // A finished RGBA8888 frame, or a partial one while refining.
+  struct Frame {
+    std::vector<uchar> pixels;
+    int width = 0, height = 0;
+    // Share of the visible edges drawn so far; 1 once complete.
+    float progress = 1.0f;
+  };
+  // What the GUI thread wants drawn. Interactive frames are drawn at a
+  // fraction of the window size with aliased lines.
+  struct FrameRequest {
+    MiniGLM::mat4 view, proj;
+    int width, height;
+    bool interactive;
+  };
+
+  // Restarted by every drag or wheel step; when it fires, the view has
+  // been still long enough for a full-quality frame.
+  QTimer idleTimer_;
+  static constexpr int kIdleRefineMs = 150;
+  // Paces interactive frames to the display. Input only moves the camera;
+  // each tick sends the latest camera if it moved, and the timer stops on
+  // the first tick without input.
+  QTimer frameTimer_;
+  bool inputPending_ = false;
+
+  // Latest request; the render thread takes the newest one each time it
+  // finishes a frame, so intermediate camera states are skipped. A request
+  // bumps the generation, which cancels the frame in flight, unless both
+  // are interactive: that frame is nearly done and is let through.
+  std::mutex requestMutex_;
+  std::condition_variable requestCv_;
+  FrameRequest request_;
+  uint64_t requested_ = 0;
+  bool renderingInteractive_ = false;
+  std::atomic<uint64_t> generation_{0};
+  bool stopRendering_ = false;
+  // Frames go from the render thread to paintEvent without locking.
+  TripleBuffer<Frame> frames_;
+
+  // Render state, owned by the render thread (and its pool chunks) once
+  // it runs. The mesh structures are read-only after construction.
+  int renderWidth_, renderHeight_;
+  // Fires once a newer request arrives; checked between chunks.
+  CancelToken frameCancel_;
+  // The frame being drawn is interactive.
+  bool fastFrame_ = false;
+  // Resolution scale of interactive frames, adapted towards the budget.
+  float interactiveScale_;
+  static constexpr double kInteractiveBudgetMs = 16.0;
+  static constexpr float kMinInteractiveScale = 0.1f;
+  // Full-quality frames of big meshes are published after every slice of
+  // this length, so the first image and each refinement arrive promptly.
+  static constexpr double kRefineSliceMs = 33.0;
+  // Clusters per worker drawn between two checks of the slice clock.
+  static constexpr size_t kRefineBatchPerWorker = 32;
+  static constexpr size_t kClustersPerPriorityChunk = 1024;
   VertexProcessor processor;
   Rasterizer raster;
-  Clipper nearClipper;
-  Clipper screenClipper;
+  ClipStage clipStage;
 
   std::vector<MiniGLM::vec3> vertices;
-  std::vector<std::pair<int, int>> edges;
+  std::vector<int> triangles;
+  // Edges regrouped into clusters under a BVH for culling and picking; the
+  // render loop only reads these.
+  EdgeBvh bvh;
+  // Set with --cull-backfaces or --outline; updated once per frame before
+  // the workers start.
+  std::unique_ptr<EdgeFilter> edgeFilter;
+  // Simplified clusters, empty unless --lod.
+  EdgeLod lod;
+  // Set with --occlusion/--occluders; culls visibleClusters per frame.
+  std::unique_ptr<OcclusionBuffer> occlusion;
+
+  RenderOptions options_;
 
-  std::vector<std::thread> threadPool;
-  std::queue<std::pair<size_t, size_t>> workQueue;
-  std::mutex queueMutex;
-  std::condition_variable queueCV;
-  std::atomic<bool> quitFlag{false};
-  std::atomic<int> tasksPending{0};
+  // The shared pool; the worker index of a chunk picks the private buffers
+  // it writes.
+  ThreadPool &pool = ThreadPool::shared();
+  static constexpr size_t kChunksPerWorker = 8;
+  // Segments drawn between two cancellation checks.
+  static constexpr size_t kSegmentsPerCancelCheck = 256;
+  // Framebuffer rows per chunk of the RGBA copy.
+  static constexpr size_t kRowsPerChunk = 32;
+  // Interactive frames draw into the shared raster in row bands, a few per
+  // worker so stealing can even out bands with more lines.
+  static constexpr size_t kAliasedBandsPerWorker = 4;
 
-  std::vector<MiniGLM::vec4> workerClipSpace;
+  std::vector<uint32_t> visibleClusters;
+  // Projected size and index of each visible cluster, for the draw order.
+  std::vector<std::pair<float, uint32_t>> clusterPriority;
+  size_t culledEdges = 0;
+  size_t occludedEdges = 0;
+  std::vector<MiniGLM::vec4> clusterClipSpace;
+  std::vector<MiniGLM::vec4> lodClipSpace;
   Color workerColor = Color(255, 255, 255);
-  float workerNearEpsilon = 1e-3f;
-  float workerNdcLimit = 100.0f;
+  std::vector<std::vector<ScreenSegment>> workerSegments;
+  // Interactive frames only: per worker and row band, the clipped segments
+  // reaching into the band, drawn once every chunk is clipped.
+  std::vector<std::vector<std::vector<ScreenSegment>>> workerBandSegments;
+  int bandRows = 1;
+  std::vector<ClipStats> workerClipStats;
+  std::vector<SegmentDedup> workerDedup;
+  std::vector<CoverageBuffer> workerCoverage;
+  std::vector<DensityBuffer> workerDensity;
+  std::unique_ptr<DepthBuffer> depthBuffer;
+
+  std::thread renderThread_;
 
-  void renderModel();
+  void requestFrame(bool interactive = false);
+  void scheduleFrame();
+  void frameTick();
+  void renderLoop();
+  void renderModel(const FrameRequest &request);
 
-  void drawEdgesMultithreaded(const std::vector<MiniGLM::vec4> &clip_space);
-  void drawEdgesInRange(const std::vector<MiniGLM::vec4> &clip_space,
-                        size_t start, size_t end, const Color &color,
-                        float near_epsilon, float ndc_limit);
+  void prioritizeClusters(const MiniGLM::mat4 &mvp);
+  void clearWorkerBuffers();
+  void drawEdgesMultithreaded(size_t begin, size_t end);
+  void drawEdgesInRange(size_t start, size_t end, const Color &color,
+                        size_t slot);
+  void drawAliasedBands();
+  void publishFrame(float progress);
 
-  void allocateBuffer();
-  void freeBuffer();
-  void updateImage();
+  void resizeFrameTargets(int width, int height);
+  void allocateWorkerBuffers(int width, int height);
 
   MiniGLM::vec3 computeCenter(const std::vector<MiniGLM::vec3> &vertices);
 
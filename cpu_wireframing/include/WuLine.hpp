@@ -0,0 +1,105 @@
+#pragma once
+
+#include "MiniGLM.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace WuLine {
+
+inline float frac(float x) { return x - std::floor(x); }
+
+/**
+ * @brief Walks an anti-aliased line with Xiaolin Wu's algorithm and hands
+ * every covered pixel to a plot callback.
+ *
+ * The callback is invoked as plot(x, y, intensity) with intensity in [0, 1].
+ * Keeping the traversal separate from the pixel write lets the RGBA
+ * rasterizer and the per-thread coverage buffers share the exact same line
+ * shape.
+ *
+ * Endpoints may lie outside the viewport (guard-band clipping leaves the
+ * overhang to the rasterizer): the interior span is clamped to the major-axis
+ * range where the line is on screen, so off-screen pixels are never walked.
+ * The callback still has to bounds-check the few endpoint samples.
+ *
+ * @param p0 The starting point of the line in pixel coordinates.
+ * @param p1 The ending point of the line in pixel coordinates.
+ * @param clipW Viewport width.
+ * @param clipH Viewport height.
+ * @param plot Callback receiving each pixel and its coverage.
+ */
+template <typename Plot>
+inline void trace(const MiniGLM::ivec2 &p0, const MiniGLM::ivec2 &p1,
+                  int clipW, int clipH, Plot &&plot) {
+  int x0 = p0.x, y0 = p0.y;
+  int x1 = p1.x, y1 = p1.y;
+  bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+
+  if (steep) {
+    std::swap(x0, y0);
+    std::swap(x1, y1);
+  }
+  if (x0 > x1) {
+    std::swap(x0, x1);
+    std::swap(y0, y1);
+  }
+
+  float dx = float(x1 - x0);
+  float dy = float(y1 - y0);
+  float gradient = dx == 0.0f ? 1.0f : dy / dx;
+
+  int xEnd = x0;
+  float yEnd = y0 + gradient * (xEnd - x0);
+  int xPixel1 = xEnd;
+  int yPixel1 = int(yEnd);
+
+  if (steep) {
+    plot(yPixel1, xPixel1, 1 - frac(yEnd));
+    plot(yPixel1 + 1, xPixel1, frac(yEnd));
+  } else {
+    plot(xPixel1, yPixel1, 1 - frac(yEnd));
+    plot(xPixel1, yPixel1 + 1, frac(yEnd));
+  }
+
+  // Clamp the interior to the on-screen major range, then to where the two
+  // minor-axis samples (floor(y) and floor(y) + 1) can land inside.
+  const int uLimit = steep ? clipH : clipW, vLimit = steep ? clipW : clipH;
+  int xFirst = std::max(xPixel1 + 1, 0), xLast = std::min(x1 - 1, uLimit - 1);
+  if (gradient != 0.0f) {
+    float ea = x0 + (-1.0f - yEnd) / gradient;
+    float eb = x0 + (float(vLimit) - yEnd) / gradient;
+    float lo = std::floor(std::min(ea, eb)), hi = std::ceil(std::max(ea, eb));
+    if (lo > float(xFirst))
+      xFirst = lo > float(xLast) ? xLast + 1 : int(lo);
+    if (hi < float(xLast))
+      xLast = hi < float(xFirst) ? xFirst - 1 : int(hi);
+  } else if (yEnd < -1.0f || yEnd >= float(vLimit)) {
+    xLast = xFirst - 1;
+  }
+  float y = yEnd + gradient * float(xFirst - x0);
+
+  for (int x = xFirst; x <= xLast; ++x) {
+    int yPix = int(std::floor(y));
+    if (steep) {
+      plot(yPix, x, 1 - frac(y));
+      plot(yPix + 1, x, frac(y));
+    } else {
+      plot(x, yPix, 1 - frac(y));
+      plot(x, yPix + 1, frac(y));
+    }
+    y += gradient;
+  }
+
+  int xPixel2 = x1;
+  float yPixel2 = y1;
+  if (steep) {
+    plot(int(yPixel2), xPixel2, 1 - frac(yPixel2));
+    plot(int(yPixel2) + 1, xPixel2, frac(yPixel2));
+  } else {
+    plot(xPixel2, int(yPixel2), 1 - frac(yPixel2));
+    plot(xPixel2, int(yPixel2) + 1, frac(yPixel2));
+  }
+}
+
+} // namespace WuLine
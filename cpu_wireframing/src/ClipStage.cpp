@@ -0,0 +1,223 @@
+#include "ClipStage.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+ClipStats &ClipStats::operator+=(const ClipStats &other) {
+  culled += other.culled;
+  occluded += other.occluded;
+  simplified += other.simplified;
+  input += other.input;
+  filtered += other.filtered;
+  trivialReject += other.trivialReject;
+  trivialAccept += other.trivialAccept;
+  clipped += other.clipped;
+  clippedAway += other.clippedAway;
+  tooShort += other.tooShort;
+  duplicates += other.duplicates;
+  emitted += other.emitted;
+  return *this;
+}
+
+std::ostream &operator<<(std::ostream &os, const ClipStats &stats) {
+  return os << "clip: " << stats.culled << " edges culled by cluster, "
+            << stats.occluded << " occluded, " << stats.simplified
+            << " simplified away, " << stats.input << " edges, "
+            << stats.filtered << " filtered, " << stats.trivialReject
+            << " rejected, " << stats.trivialAccept << " accepted, "
+            << stats.clipped << " clipped (" << stats.clippedAway
+            << " empty), " << stats.tooShort << " too short, "
+            << stats.duplicates << " duplicates, " << stats.emitted
+            << " drawn";
+}
+
+ClipStage::ClipStage(int width, int height)
+    : width_(width), height_(height), clipper_() {}
+
+void ClipStage::setViewport(int width, int height) {
+  width_ = width;
+  height_ = height;
+}
+
+/**
+ * @brief Appends a segment whose endpoints are already in pixel
+ * coordinates, unless it covers less than two pixels.
+ */
+static void push(float x0, float y0, float z0, float x1, float y1, float z1,
+                 std::vector<ScreenSegment> &out, ClipStats &stats) {
+  MiniGLM::ivec2 p0 = toPixel(MiniGLM::vec2(x0, y0));
+  MiniGLM::ivec2 p1 = toPixel(MiniGLM::vec2(x1, y1));
+  // 64-bit, guard-band segments can be several viewports long.
+  long long dx = p0.x - p1.x, dy = p0.y - p1.y;
+  if ((dx * dx + dy * dy) < 4) {
+    ++stats.tooShort;
+    return;
+  }
+  out.push_back({MiniGLM::vec2(x0, y0), MiniGLM::vec2(x1, y1), z0, z1});
+  ++stats.emitted;
+}
+
+/**
+ * @brief Projects two clip-space endpoints inside the frustum to the
+ * viewport and appends the segment.
+ */
+void ClipStage::emit(const MiniGLM::vec4 &c0, const MiniGLM::vec4 &c1,
+                     std::vector<ScreenSegment> &out,
+                     ClipStats &stats) const {
+  float ndc_x0 = c0.x / c0.w, ndc_y0 = c0.y / c0.w;
+  float ndc_x1 = c1.x / c1.w, ndc_y1 = c1.y / c1.w;
+  push((ndc_x0 * 0.5f + 0.5f) * width_,
+       (1.0f - (ndc_y0 * 0.5f + 0.5f)) * height_, c0.z / c0.w * 0.5f + 0.5f,
+       (ndc_x1 * 0.5f + 0.5f) * width_,
+       (1.0f - (ndc_y1 * 0.5f + 0.5f)) * height_, c1.z / c1.w * 0.5f + 0.5f,
+       out, stats);
+}
+
+/**
+ * @brief Scalar path for a single edge: outcode classification, then
+ * Liang-Barsky clipping for edges that leave the guard band.
+ */
+void ClipStage::clipOne(MiniGLM::vec4 c0, MiniGLM::vec4 c1,
+                        std::vector<ScreenSegment> &out,
+                        ClipStats &stats) const {
+  if (Clipper::computeFrustumCode(c0) & Clipper::computeFrustumCode(c1)) {
+    ++stats.trivialReject;
+    return;
+  }
+  const float guard = clipper_.guardBand();
+  bool inside = (Clipper::computeFrustumCode(c0, guard) |
+                 Clipper::computeFrustumCode(c1, guard)) == 0;
+  if (!clipper_.clipLineToFrustum(c0, c1)) {
+    ++(inside ? stats.trivialReject : stats.clippedAway);
+    return;
+  }
+  ++(inside ? stats.trivialAccept : stats.clipped);
+  emit(c0, c1, out, stats);
+}
+
+/**
+ * @brief Clips edges [begin, end) and appends the visible segments to out.
+ *
+ * Batches of four edges are classified in SSE2 registers: each endpoint is
+ * tested against the six planes at once per lane, lanes where both
+ * endpoints share an outside plane are rejected, lanes with both endpoints
+ * inside the guard band are projected to pixels in the same pass, and the
+ * remaining lanes fall back to clipOne. The tail (and non-SSE2 builds) use
+ * clipOne throughout. Edges the filter culls are masked out per lane before
+ * any of that, and a batch of four culled edges is skipped whole.
+ */
+void ClipStage::run(const std::vector<MiniGLM::vec4> &clip,
+                    const std::vector<std::pair<int, int>> &edges,
+                    size_t begin, size_t end, std::vector<ScreenSegment> &out,
+                    ClipStats &stats, const EdgeFilter *filter) const {
+  stats.input += end - begin;
+  size_t i = begin;
+#if defined(__SSE2__)
+  const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  const __m128 vW = _mm_set1_ps(float(width_));
+  const __m128 vH = _mm_set1_ps(float(height_));
+  const float guard = clipper_.guardBand();
+  const __m128 vGuard = _mm_set1_ps(guard);
+
+  // Lanes whose point lies outside any plane, and per-plane masks so that
+  // two endpoints outside the same plane can be detected.
+  struct Classified {
+    __m128 out[6];
+    __m128 any;
+  };
+  // The x/y planes are at +-gw, i.e. w or the guard band.
+  auto classify = [&](__m128 x, __m128 y, __m128 z, __m128 w, __m128 gw) {
+    Classified c;
+    __m128 nw = _mm_xor_ps(w, sign), ngw = _mm_xor_ps(gw, sign);
+    c.out[0] = _mm_cmplt_ps(x, ngw);
+    c.out[1] = _mm_cmpgt_ps(x, gw);
+    c.out[2] = _mm_cmplt_ps(y, ngw);
+    c.out[3] = _mm_cmpgt_ps(y, gw);
+    c.out[4] = _mm_cmplt_ps(z, nw);
+    c.out[5] = _mm_cmpgt_ps(z, w);
+    c.any = c.out[0];
+    for (int p = 1; p < 6; ++p)
+      c.any = _mm_or_ps(c.any, c.out[p]);
+    return c;
+  };
+
+  alignas(16) float g[8][4];
+  alignas(16) float s[6][4];
+  for (; i + 4 <= end; i += 4) {
+    int filterMask = 0;
+    if (filter) {
+      for (int l = 0; l < 4; ++l)
+        filterMask |= int(filter->culled(i + l)) << l;
+      if (filterMask == 0xF) {
+        stats.filtered += 4;
+        continue;
+      }
+    }
+    for (int l = 0; l < 4; ++l) {
+      const MiniGLM::vec4 &a = clip[edges[i + l].first];
+      const MiniGLM::vec4 &b = clip[edges[i + l].second];
+      g[0][l] = a.x, g[1][l] = a.y, g[2][l] = a.z, g[3][l] = a.w;
+      g[4][l] = b.x, g[5][l] = b.y, g[6][l] = b.z, g[7][l] = b.w;
+    }
+    __m128 x0 = _mm_load_ps(g[0]), y0 = _mm_load_ps(g[1]);
+    __m128 z0 = _mm_load_ps(g[2]), w0 = _mm_load_ps(g[3]);
+    __m128 x1 = _mm_load_ps(g[4]), y1 = _mm_load_ps(g[5]);
+    __m128 z1 = _mm_load_ps(g[6]), w1 = _mm_load_ps(g[7]);
+
+    Classified c0 = classify(x0, y0, z0, w0, w0);
+    Classified c1 = classify(x1, y1, z1, w1, w1);
+    __m128 reject = _mm_and_ps(c0.out[0], c1.out[0]);
+    for (int p = 1; p < 6; ++p)
+      reject = _mm_or_ps(reject, _mm_and_ps(c0.out[p], c1.out[p]));
+    if (guard != 1.0f) {
+      c0 = classify(x0, y0, z0, w0, _mm_mul_ps(w0, vGuard));
+      c1 = classify(x1, y1, z1, w1, _mm_mul_ps(w1, vGuard));
+    }
+    __m128 accept = _mm_andnot_ps(
+        _mm_or_ps(c0.any, c1.any),
+        _mm_and_ps(_mm_cmpgt_ps(w0, zero), _mm_cmpgt_ps(w1, zero)));
+    int rejectMask = _mm_movemask_ps(reject) & ~filterMask;
+    int acceptMask = _mm_movemask_ps(accept);
+
+    if (rejectMask == 0xF) {
+      stats.trivialReject += 4;
+      continue;
+    }
+    if (acceptMask) {
+      // Same expression order as emit(), so both paths give equal pixels.
+      auto toUnit = [&](__m128 v, __m128 w) {
+        return _mm_add_ps(_mm_mul_ps(_mm_div_ps(v, w), half), half);
+      };
+      _mm_store_ps(s[0], _mm_mul_ps(toUnit(x0, w0), vW));
+      _mm_store_ps(s[1], _mm_mul_ps(_mm_sub_ps(one, toUnit(y0, w0)), vH));
+      _mm_store_ps(s[2], toUnit(z0, w0));
+      _mm_store_ps(s[3], _mm_mul_ps(toUnit(x1, w1), vW));
+      _mm_store_ps(s[4], _mm_mul_ps(_mm_sub_ps(one, toUnit(y1, w1)), vH));
+      _mm_store_ps(s[5], toUnit(z1, w1));
+    }
+    for (int l = 0; l < 4; ++l) {
+      if (filterMask & (1 << l)) {
+        ++stats.filtered;
+      } else if (rejectMask & (1 << l)) {
+        ++stats.trivialReject;
+      } else if (acceptMask & (1 << l)) {
+        ++stats.trivialAccept;
+        push(s[0][l], s[1][l], s[2][l], s[3][l], s[4][l], s[5][l], out,
+             stats);
+      } else {
+        clipOne(clip[edges[i + l].first], clip[edges[i + l].second], out,
+                stats);
+      }
+    }
+  }
+#endif
+  for (; i < end; ++i) {
+    if (filter && filter->culled(i))
+      ++stats.filtered;
+    else
+      clipOne(clip[edges[i].first], clip[edges[i].second], out, stats);
+  }
+}
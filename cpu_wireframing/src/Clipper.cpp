@@ -9,6 +9,10 @@ Clipper::Clipper(int xmin, int ymin, int xmax, int ymax)
 Clipper::Clipper(float nearPlane)
     : xmin_(0), ymin_(0), xmax_(0), ymax_(0), nearPlane_(nearPlane) {}
 
+// Frustum clipping constructor; the planes are implied by w, no bounds needed
+Clipper::Clipper()
+    : xmin_(0), ymin_(0), xmax_(0), ymax_(0), nearPlane_(0.0f) {}
+
 int Clipper::computeOutCode(int x, int y) const {
   int code = INSIDE;
   if (x < xmin_)
@@ -60,6 +64,72 @@ bool Clipper::clipLineNearPlane(MiniGLM::vec4 &p0, MiniGLM::vec4 &p1) const {
   return true;
 }
 
+int Clipper::computeFrustumCode(const MiniGLM::vec4 &p, float guardBand) {
+  const float gw = guardBand * p.w;
+  int code = 0;
+  if (p.x < -gw)
+    code |= X_NEG;
+  if (p.x > gw)
+    code |= X_POS;
+  if (p.y < -gw)
+    code |= Y_NEG;
+  if (p.y > gw)
+    code |= Y_POS;
+  if (p.z < -p.w)
+    code |= Z_NEG;
+  if (p.z > p.w)
+    code |= Z_POS;
+  return code;
+}
+
+/**
+ * @brief Clips a clip-space line against the six view-frustum planes with
+ * the Liang-Barsky algorithm.
+ *
+ * Outcodes accept lines that are fully inside and reject lines that lie
+ * fully outside one plane without any arithmetic. Otherwise each plane's
+ * signed distance (w +- coordinate) is evaluated at both ends and the
+ * parametric interval [t0, t1] is narrowed, all in float, so endpoints far
+ * outside the viewport cannot overflow the way integer screen coordinates
+ * would. Afterwards every endpoint has w > 0 and NDC inside [-1, 1], or
+ * inside [-g, g] in x and y when a guard band g is set.
+ *
+ * @param p0 First endpoint, replaced by the clipped endpoint.
+ * @param p1 Second endpoint, replaced by the clipped endpoint.
+ * @return false if no part of the line is inside the frustum.
+ */
+bool Clipper::clipLineToFrustum(MiniGLM::vec4 &p0, MiniGLM::vec4 &p1) const {
+  int code0 = computeFrustumCode(p0, guardBand_);
+  int code1 = computeFrustumCode(p1, guardBand_);
+  if ((code0 | code1) == 0)
+    return p0.w > 0.0f && p1.w > 0.0f;
+  if (code0 & code1)
+    return false;
+
+  const float g0 = guardBand_ * p0.w, g1 = guardBand_ * p1.w;
+  const float d0[6] = {g0 + p0.x, g0 - p0.x, g0 + p0.y,
+                       g0 - p0.y, p0.w + p0.z, p0.w - p0.z};
+  const float d1[6] = {g1 + p1.x, g1 - p1.x, g1 + p1.y,
+                       g1 - p1.y, p1.w + p1.z, p1.w - p1.z};
+  float t0 = 0.0f, t1 = 1.0f;
+  for (int i = 0; i < 6; ++i) {
+    if (d0[i] < 0.0f) {
+      t0 = std::max(t0, d0[i] / (d0[i] - d1[i]));
+    } else if (d1[i] < 0.0f) {
+      t1 = std::min(t1, d0[i] / (d0[i] - d1[i]));
+    }
+    if (t0 > t1)
+      return false;
+  }
+
+  const MiniGLM::vec4 a = p0, b = p1;
+  if (code0)
+    p0 = lerp(a, b, t0);
+  if (code1)
+    p1 = lerp(a, b, t1);
+  return p0.w > 0.0f && p1.w > 0.0f;
+}
+
 // Existing screen clipping function (unchanged)
 bool Clipper::clipLine(MiniGLM::ivec2 &p0, MiniGLM::ivec2 &p1) const {
   int x0 = p0.x, y0 = p0.y;
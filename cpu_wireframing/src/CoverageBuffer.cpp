@@ -0,0 +1,117 @@
+#include "CoverageBuffer.hpp"
+#include "CapsuleLine.hpp"
+#include "WuLine.hpp"
+#include <algorithm>
+#include <cstring>
+
+/**
+ * @brief Constructs an empty coverage buffer of the given size.
+ *
+ * @param width Width of the buffer in pixels.
+ * @param height Height of the buffer in pixels.
+ * @param merge How coverage of overlapping lines is combined.
+ */
+CoverageBuffer::CoverageBuffer(int width, int height, CoverageMerge merge)
+    : width_(width), height_(height), merge_(merge),
+      alpha_(size_t(width) * height), dirtyMinY_(height), dirtyMaxY_(-1) {}
+
+/**
+ * @brief Resets the rows touched since the previous clear to zero coverage.
+ *
+ * Only the dirty row range is cleared, so a worker that drew a handful of
+ * lines near the top of the screen does not pay for the whole buffer.
+ */
+void CoverageBuffer::clear() {
+  if (dirtyMinY_ <= dirtyMaxY_)
+    std::memset(alpha_.data() + dirtyMinY_ * width_, 0,
+                size_t(dirtyMaxY_ - dirtyMinY_ + 1) * width_);
+  dirtyMinY_ = height_;
+  dirtyMaxY_ = -1;
+}
+
+/**
+ * @brief Clears the dirty rows at the old row stride, so the whole vector
+ * is zero, then resizes it; elements that come back into use after a
+ * shrink are zeroed again by the vector.
+ */
+void CoverageBuffer::resize(int width, int height) {
+  clear();
+  width_ = width;
+  height_ = height;
+  alpha_.resize(size_t(width) * height);
+  dirtyMinY_ = height;
+}
+
+void CoverageBuffer::plot(int x, int y, float intensity) {
+  if (x < 0 || x >= width_ || y < 0 || y >= height_)
+    return;
+  int cov = static_cast<int>(intensity * 255.0f + 0.5f);
+  if (cov <= 0)
+    return;
+  uint8_t &dest = alpha_[y * width_ + x];
+  if (merge_ == CoverageMerge::Max)
+    dest = static_cast<uint8_t>(std::max<int>(dest, cov));
+  else
+    dest = static_cast<uint8_t>(std::min(255, dest + cov));
+}
+
+/**
+ * @brief Records the coverage of an anti-aliased line.
+ *
+ * Uses the same Wu traversal as Rasterizer::drawLine, so resolving a single
+ * buffer reproduces the shared-framebuffer output.
+ *
+ * @param p0 The starting point of the line (as integer pixel coordinates).
+ * @param p1 The ending point of the line (as integer pixel coordinates).
+ */
+void CoverageBuffer::drawLine(const MiniGLM::ivec2 &p0,
+                              const MiniGLM::ivec2 &p1) {
+  markDirty(p0, p1);
+  WuLine::trace(p0, p1, width_, height_,
+                [this](int x, int y, float intensity) {
+                  plot(x, y, intensity);
+                });
+}
+
+/**
+ * @brief Records the coverage of the parts of a line that pass the depth
+ * test.
+ */
+void CoverageBuffer::drawLine(const MiniGLM::ivec2 &p0,
+                              const MiniGLM::ivec2 &p1, float z0, float z1,
+                              const DepthBuffer &depth) {
+  markDirty(p0, p1);
+  depth.traceVisible(p0, p1, z0, z1, [this](int x, int y, float intensity) {
+    plot(x, y, intensity);
+  });
+}
+
+/**
+ * @brief Records the coverage of a wide anti-aliased capsule line, optionally
+ * depth-tested.
+ */
+void CoverageBuffer::drawThickLine(const MiniGLM::vec2 &p0,
+                                   const MiniGLM::vec2 &p1, float width,
+                                   const DepthBuffer *depth, float z0,
+                                   float z1) {
+  CapsuleLine::trace(p0, p1, width, width_, height_,
+                     [&](int y, int x, int count, const float *cov,
+                         const float *t) {
+                       dirtyMinY_ = std::min(dirtyMinY_, y);
+                       dirtyMaxY_ = std::max(dirtyMaxY_, y);
+                       for (int i = 0; i < count; ++i) {
+                         if (depth &&
+                             !depth->visible(x + i, y, z0 + (z1 - z0) * t[i]))
+                           continue;
+                         plot(x + i, y, cov[i]);
+                       }
+                     });
+}
+
+// Wu writes at most one row past the lower endpoint.
+void CoverageBuffer::markDirty(const MiniGLM::ivec2 &p0,
+                               const MiniGLM::ivec2 &p1) {
+  dirtyMinY_ = std::min(dirtyMinY_, std::max(0, std::min(p0.y, p1.y)));
+  dirtyMaxY_ =
+      std::max(dirtyMaxY_, std::min(height_ - 1, std::max(p0.y, p1.y) + 1));
+}
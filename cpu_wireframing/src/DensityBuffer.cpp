@@ -0,0 +1,106 @@
+#include "DensityBuffer.hpp"
+#include "CapsuleLine.hpp"
+#include "WuLine.hpp"
+#include <algorithm>
+#include <cstring>
+
+/**
+ * @brief Constructs a zeroed density buffer of the given size.
+ *
+ * @param width Width of the buffer in pixels.
+ * @param height Height of the buffer in pixels.
+ */
+DensityBuffer::DensityBuffer(int width, int height)
+    : width_(width), height_(height), counts_(size_t(width) * height),
+      dirtyMinY_(height), dirtyMaxY_(-1) {}
+
+/**
+ * @brief Zeroes the rows touched since the previous clear.
+ */
+void DensityBuffer::clear() {
+  if (dirtyMinY_ <= dirtyMaxY_)
+    std::memset(counts_.data() + dirtyMinY_ * width_, 0,
+                size_t(dirtyMaxY_ - dirtyMinY_ + 1) * width_ *
+                    sizeof(uint16_t));
+  dirtyMinY_ = height_;
+  dirtyMaxY_ = -1;
+}
+
+/**
+ * @brief Same scheme as CoverageBuffer::resize(): clear at the old stride,
+ * then resize the counters, which zeroes any element regained.
+ */
+void DensityBuffer::resize(int width, int height) {
+  clear();
+  width_ = width;
+  height_ = height;
+  counts_.resize(size_t(width) * height);
+  dirtyMinY_ = height;
+}
+
+/**
+ * @brief Adds the Wu coverage of a line to the per-pixel counters.
+ *
+ * Counters saturate at 65535, which is roughly a thousand full-coverage hits
+ * per worker and pixel.
+ *
+ * @param p0 The starting point of the line (as integer pixel coordinates).
+ * @param p1 The ending point of the line (as integer pixel coordinates).
+ */
+void DensityBuffer::drawLine(const MiniGLM::ivec2 &p0,
+                             const MiniGLM::ivec2 &p1) {
+  markDirty(p0, p1);
+  WuLine::trace(p0, p1, width_, height_,
+                [this](int x, int y, float intensity) {
+                  add(x, y, intensity);
+                });
+}
+
+/**
+ * @brief Accumulates only the parts of a line that pass the depth test.
+ */
+void DensityBuffer::drawLine(const MiniGLM::ivec2 &p0,
+                             const MiniGLM::ivec2 &p1, float z0, float z1,
+                             const DepthBuffer &depth) {
+  markDirty(p0, p1);
+  depth.traceVisible(p0, p1, z0, z1, [this](int x, int y, float intensity) {
+    add(x, y, intensity);
+  });
+}
+
+/**
+ * @brief Accumulates the coverage of a wide anti-aliased capsule line,
+ * optionally depth-tested.
+ */
+void DensityBuffer::drawThickLine(const MiniGLM::vec2 &p0,
+                                  const MiniGLM::vec2 &p1, float width,
+                                  const DepthBuffer *depth, float z0,
+                                  float z1) {
+  CapsuleLine::trace(p0, p1, width, width_, height_,
+                     [&](int y, int x, int count, const float *cov,
+                         const float *t) {
+                       dirtyMinY_ = std::min(dirtyMinY_, y);
+                       dirtyMaxY_ = std::max(dirtyMaxY_, y);
+                       for (int i = 0; i < count; ++i) {
+                         if (depth &&
+                             !depth->visible(x + i, y, z0 + (z1 - z0) * t[i]))
+                           continue;
+                         add(x + i, y, cov[i]);
+                       }
+                     });
+}
+
+void DensityBuffer::add(int x, int y, float intensity) {
+  if (x < 0 || x >= width_ || y < 0 || y >= height_)
+    return;
+  int units = static_cast<int>(intensity * kUnitsPerHit + 0.5f);
+  uint16_t &dest = counts_[y * width_ + x];
+  dest = static_cast<uint16_t>(std::min(65535, dest + units));
+}
+
+void DensityBuffer::markDirty(const MiniGLM::ivec2 &p0,
+                              const MiniGLM::ivec2 &p1) {
+  dirtyMinY_ = std::min(dirtyMinY_, std::max(0, std::min(p0.y, p1.y)));
+  dirtyMaxY_ =
+      std::max(dirtyMaxY_, std::min(height_ - 1, std::max(p0.y, p1.y) + 1));
+}
@@ -0,0 +1,286 @@
+#include "DepthBuffer.hpp"
+#include "Parallel.hpp"
+#include <algorithm>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief Constructs a depth buffer cleared to "nothing drawn".
+ *
+ * @param width Width of the buffer in pixels.
+ * @param height Height of the buffer in pixels.
+ * @param constantBias Depth offset added to every face sample.
+ * @param slopeBias Multiplier of the face depth slope added to its samples.
+ */
+DepthBuffer::DepthBuffer(int width, int height, float constantBias,
+                         float slopeBias)
+    : width_(width), height_(height),
+      tilesX_((width + kTileSize - 1) / kTileSize),
+      tilesY_((height + kTileSize - 1) / kTileSize),
+      constantBias_(constantBias), slopeBias_(slopeBias),
+      depth_(size_t(width) * height), tileMax_(size_t(tilesX_) * tilesY_) {
+  clear();
+}
+
+/**
+ * @brief Resets every pixel and tile to infinitely far away, so lines over
+ * the background always pass the depth test.
+ */
+void DepthBuffer::clear() {
+  std::fill(depth_.begin(), depth_.end(),
+            std::numeric_limits<float>::infinity());
+  std::fill(tileMax_.begin(), tileMax_.end(),
+            std::numeric_limits<float>::infinity());
+}
+
+void DepthBuffer::resize(int width, int height) {
+  width_ = width;
+  height_ = height;
+  tilesX_ = (width + kTileSize - 1) / kTileSize;
+  tilesY_ = (height + kTileSize - 1) / kTileSize;
+  depth_.resize(size_t(width) * height);
+  tileMax_.resize(size_t(tilesX_) * tilesY_);
+  clear();
+}
+
+/**
+ * @brief Rasterizes triangles into the depth buffer and rebuilds the tile
+ * hierarchy.
+ *
+ * Setup (near-plane clipping, perspective divide, viewport mapping) runs in
+ * parallel over the triangle list. Rasterization then splits the screen into
+ * horizontal bands aligned to tile rows; each thread walks all set-up
+ * triangles, skips those outside its band and fills the rest, so no two
+ * threads ever write the same pixel.
+ *
+ * @param clip Clip-space vertex positions.
+ * @param triangles Three indices into clip per triangle.
+ * @param nearW Triangles are clipped against w >= nearW before the divide.
+ * @param cancel Polled every kCancelInterval triangles by each thread.
+ */
+void DepthBuffer::rasterize(const std::vector<MiniGLM::vec4> &clip,
+                            const std::vector<int> &triangles, float nearW,
+                            const CancelToken &cancel) {
+  const size_t numThreads = Parallel::threadCount();
+  const size_t triCount = triangles.size() / 3;
+  std::vector<std::vector<Triangle>> setup(numThreads);
+
+  Parallel::forEachChunk(triCount, numThreads, [&](size_t begin, size_t end,
+                                                   size_t chunk) {
+    std::vector<Triangle> &out = setup[chunk];
+    out.reserve(end - begin);
+    for (size_t t = begin; t < end; ++t) {
+      if ((t - begin) % kCancelInterval == 0 && cancel.cancelled())
+        return;
+      MiniGLM::vec4 in[3] = {clip[triangles[t * 3 + 0]],
+                             clip[triangles[t * 3 + 1]],
+                             clip[triangles[t * 3 + 2]]};
+      if (in[0].w < nearW && in[1].w < nearW && in[2].w < nearW)
+        continue;
+
+      // Sutherland-Hodgman against the near plane: at most four vertices.
+      MiniGLM::vec4 poly[4];
+      int n = 0;
+      for (int i = 0; i < 3; ++i) {
+        const MiniGLM::vec4 &a = in[i];
+        const MiniGLM::vec4 &b = in[(i + 1) % 3];
+        bool aIn = a.w >= nearW, bIn = b.w >= nearW;
+        if (aIn)
+          poly[n++] = a;
+        if (aIn != bIn)
+          poly[n++] = a + (b - a) * ((nearW - a.w) / (b.w - a.w));
+      }
+
+      float sx[4], sy[4], sz[4];
+      for (int i = 0; i < n; ++i) {
+        float invW = 1.0f / poly[i].w;
+        sx[i] = (poly[i].x * invW * 0.5f + 0.5f) * width_;
+        sy[i] = (1.0f - (poly[i].y * invW * 0.5f + 0.5f)) * height_;
+        sz[i] = poly[i].z * invW * 0.5f + 0.5f;
+      }
+      for (int i = 1; i + 1 < n; ++i) {
+        out.push_back({{sx[0], sx[i], sx[i + 1]},
+                       {sy[0], sy[i], sy[i + 1]},
+                       {sz[0], sz[i], sz[i + 1]}});
+      }
+    }
+  });
+
+  Parallel::forEachChunk(tilesY_, numThreads, [&](size_t tileBegin,
+                                                  size_t tileEnd, size_t) {
+    int yBegin = int(tileBegin) * kTileSize;
+    int yEnd = std::min(height_, int(tileEnd) * kTileSize);
+    for (const auto &chunk : setup) {
+      for (size_t t = 0; t < chunk.size(); ++t) {
+        if (t % kCancelInterval == 0 && cancel.cancelled())
+          return;
+        rasterizeTriangle(chunk[t], yBegin, yEnd);
+      }
+    }
+    buildHierarchy(int(tileBegin), int(tileEnd));
+  });
+}
+
+/**
+ * @brief Fills the rows [yBegin, yEnd) of one screen-space triangle, keeping
+ * the nearest depth per pixel.
+ *
+ * Edge functions and the depth plane are set up in double precision, since
+ * vertices just in front of the near plane can project far outside the
+ * viewport; the inner loop then steps them in float, four pixels at a time
+ * with SSE2.
+ */
+void DepthBuffer::rasterizeTriangle(const Triangle &tri, int yBegin,
+                                    int yEnd) {
+  double x0 = tri.x[0], y0 = tri.y[0], z0 = tri.z[0];
+  double x1 = tri.x[1], y1 = tri.y[1], z1 = tri.z[1];
+  double x2 = tri.x[2], y2 = tri.y[2], z2 = tri.z[2];
+
+  double area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+  if (!(std::fabs(area) > 1e-9))
+    return;
+  if (area < 0.0) {
+    std::swap(x1, x2);
+    std::swap(y1, y2);
+    std::swap(z1, z2);
+    area = -area;
+  }
+
+  double minXf = std::max(0.0, std::floor(std::min({x0, x1, x2})));
+  double maxXf =
+      std::min(double(width_ - 1), std::ceil(std::max({x0, x1, x2})));
+  double minYf = std::max(double(yBegin), std::floor(std::min({y0, y1, y2})));
+  double maxYf = std::min(double(yEnd - 1), std::ceil(std::max({y0, y1, y2})));
+  if (minXf > maxXf || minYf > maxYf)
+    return;
+  int minX = int(minXf), maxX = int(maxXf);
+  int minY = int(minYf), maxY = int(maxYf);
+
+  // E(x, y) = A * x + B * y + C, positive inside for counter-clockwise order.
+  double A[3] = {-(y1 - y0), -(y2 - y1), -(y0 - y2)};
+  double B[3] = {x1 - x0, x2 - x1, x0 - x2};
+  double C[3] = {(y1 - y0) * x0 - (x1 - x0) * y0,
+                 (y2 - y1) * x1 - (x2 - x1) * y1,
+                 (y0 - y2) * x2 - (x0 - x2) * y2};
+
+  double dzdx = ((z1 - z0) * (y2 - y0) - (y1 - y0) * (z2 - z0)) / area;
+  double dzdy = ((x1 - x0) * (z2 - z0) - (z1 - z0) * (x2 - x0)) / area;
+  double offset =
+      slopeBias_ * std::max(std::fabs(dzdx), std::fabs(dzdy)) + constantBias_;
+  double zc = z0 - dzdx * x0 - dzdy * y0 + offset;
+
+  const float a0 = float(A[0]), a1 = float(A[1]), a2 = float(A[2]);
+  const float dz = float(dzdx);
+
+  for (int y = minY; y <= maxY; ++y) {
+    float e0 = float(A[0] * minX + B[0] * y + C[0]);
+    float e1 = float(A[1] * minX + B[1] * y + C[1]);
+    float e2 = float(A[2] * minX + B[2] * y + C[2]);
+    float zRow = float(dzdx * minX + dzdy * y + zc);
+    float *row = depth_.data() + size_t(y) * width_;
+    int x = minX;
+
+#if defined(__SSE2__)
+    const __m128 ramp = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 E0 = _mm_add_ps(_mm_set1_ps(e0), _mm_mul_ps(_mm_set1_ps(a0), ramp));
+    __m128 E1 = _mm_add_ps(_mm_set1_ps(e1), _mm_mul_ps(_mm_set1_ps(a1), ramp));
+    __m128 E2 = _mm_add_ps(_mm_set1_ps(e2), _mm_mul_ps(_mm_set1_ps(a2), ramp));
+    __m128 Z = _mm_add_ps(_mm_set1_ps(zRow), _mm_mul_ps(_mm_set1_ps(dz), ramp));
+    const __m128 dE0 = _mm_set1_ps(a0 * 4.0f);
+    const __m128 dE1 = _mm_set1_ps(a1 * 4.0f);
+    const __m128 dE2 = _mm_set1_ps(a2 * 4.0f);
+    const __m128 dZ = _mm_set1_ps(dz * 4.0f);
+    for (; x + 3 <= maxX; x += 4) {
+      __m128 inside = _mm_and_ps(
+          _mm_and_ps(_mm_cmpge_ps(E0, zero), _mm_cmpge_ps(E1, zero)),
+          _mm_cmpge_ps(E2, zero));
+      if (_mm_movemask_ps(inside)) {
+        __m128 old = _mm_loadu_ps(row + x);
+        __m128 m = _mm_and_ps(inside, _mm_cmplt_ps(Z, old));
+        _mm_storeu_ps(row + x,
+                      _mm_or_ps(_mm_and_ps(m, Z), _mm_andnot_ps(m, old)));
+      }
+      E0 = _mm_add_ps(E0, dE0);
+      E1 = _mm_add_ps(E1, dE1);
+      E2 = _mm_add_ps(E2, dE2);
+      Z = _mm_add_ps(Z, dZ);
+    }
+#endif
+    for (; x <= maxX; ++x) {
+      float step = float(x - minX);
+      if (e0 + a0 * step >= 0.0f && e1 + a1 * step >= 0.0f &&
+          e2 + a2 * step >= 0.0f) {
+        float z = zRow + dz * step;
+        if (z < row[x])
+          row[x] = z;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Recomputes the farthest depth of every tile in the given tile rows.
+ */
+void DepthBuffer::buildHierarchy(int tileRowBegin, int tileRowEnd) {
+  for (int ty = tileRowBegin; ty < tileRowEnd; ++ty) {
+    int yEnd = std::min(height_, (ty + 1) * kTileSize);
+    for (int tx = 0; tx < tilesX_; ++tx) {
+      int xEnd = std::min(width_, (tx + 1) * kTileSize);
+      float farthest = 0.0f;
+      for (int y = ty * kTileSize; y < yEnd; ++y)
+        for (int x = tx * kTileSize; x < xEnd; ++x)
+          farthest = std::max(farthest, depth_[size_t(y) * width_ + x]);
+      tileMax_[size_t(ty) * tilesX_ + tx] = farthest;
+    }
+  }
+}
+
+/**
+ * @brief Conservatively tests whether a whole line is hidden, using only the
+ * per-tile farthest depths.
+ *
+ * The segment is walked one tile column (along its major axis) at a time;
+ * for each step the tiles covering its minor-axis extent are compared
+ * against the nearest depth of that piece of the line. A single tile that
+ * might show the line makes the test fail.
+ *
+ * @return true if no pixel of the line can pass the depth test.
+ */
+bool DepthBuffer::segmentOccluded(const MiniGLM::ivec2 &p0,
+                                  const MiniGLM::ivec2 &p1, float z0,
+                                  float z1) const {
+  bool steep = std::abs(p1.y - p0.y) > std::abs(p1.x - p0.x);
+  int u0 = steep ? p0.y : p0.x, v0 = steep ? p0.x : p0.y;
+  int u1 = steep ? p1.y : p1.x, v1 = steep ? p1.x : p1.y;
+  if (u0 > u1) {
+    std::swap(u0, u1);
+    std::swap(v0, v1);
+    std::swap(z0, z1);
+  }
+  float g = u1 == u0 ? 0.0f : float(v1 - v0) / float(u1 - u0);
+  float gz = u1 == u0 ? 0.0f : (z1 - z0) / float(u1 - u0);
+  int uLimit = steep ? height_ : width_;
+  int vLimit = steep ? width_ : height_;
+
+  int uStart = std::max(u0, 0), uEnd = std::min(u1, uLimit - 1);
+  for (int ua = uStart; ua <= uEnd; ua = (ua / kTileSize + 1) * kTileSize) {
+    int ub = std::min(uEnd, (ua / kTileSize) * kTileSize + kTileSize - 1);
+    float va = v0 + g * float(ua - u0), vb = v0 + g * float(ub - u0);
+    // One pixel of slack either side covers Wu's second sample and drift.
+    int vLo = std::max(0, int(std::floor(std::min(va, vb))) - 1);
+    int vHi = std::min(vLimit - 1, int(std::floor(std::max(va, vb))) + 2);
+    float zMin = std::min(z0 + gz * float(ua - u0), z0 + gz * float(ub - u0));
+    for (int tv = vLo / kTileSize; vLo <= vHi && tv <= vHi / kTileSize;
+         ++tv) {
+      int tx = steep ? tv : ua / kTileSize;
+      int ty = steep ? ua / kTileSize : tv;
+      if (zMin <= tileMax_[size_t(ty) * tilesX_ + tx])
+        return false;
+    }
+  }
+  return true;
+}
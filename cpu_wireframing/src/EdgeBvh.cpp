@@ -0,0 +1,367 @@
+#include "EdgeBvh.hpp"
+#include "BinaryIO.hpp"
+#include "Clipper.hpp"
+#include "Parallel.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+constexpr uint32_t kMagic = 0x48564245; // "EBVH"
+constexpr uint32_t kVersion = 1;
+
+MiniGLM::vec3 minVec(const MiniGLM::vec3 &a, const MiniGLM::vec3 &b) {
+  return MiniGLM::vec3(std::min(a.x, b.x), std::min(a.y, b.y),
+                       std::min(a.z, b.z));
+}
+
+MiniGLM::vec3 maxVec(const MiniGLM::vec3 &a, const MiniGLM::vec3 &b) {
+  return MiniGLM::vec3(std::max(a.x, b.x), std::max(a.y, b.y),
+                       std::max(a.z, b.z));
+}
+
+// Clip-space corners of a box and the AND/OR of their frustum outcodes.
+struct ProjectedBox {
+  MiniGLM::vec4 corner[8];
+  int andCode, orCode;
+};
+
+ProjectedBox projectBox(const MiniGLM::mat4 &mvp, const MiniGLM::vec3 &lo,
+                        const MiniGLM::vec3 &hi) {
+  ProjectedBox box;
+  box.andCode = ~0;
+  box.orCode = 0;
+  for (int i = 0; i < 8; ++i) {
+    MiniGLM::vec3 p(i & 1 ? hi.x : lo.x, i & 2 ? hi.y : lo.y,
+                    i & 4 ? hi.z : lo.z);
+    box.corner[i] = mvp * MiniGLM::vec4(p, 1.0f);
+    int code = Clipper::computeFrustumCode(box.corner[i]);
+    box.andCode &= code;
+    box.orCode |= code;
+  }
+  return box;
+}
+
+} // namespace
+
+/**
+ * @brief Clusters the edges and builds the hierarchy over the clusters.
+ */
+EdgeBvh::EdgeBvh(const std::vector<MiniGLM::vec3> &vertices,
+                 const std::vector<std::pair<int, int>> &edges)
+    : clusters_(vertices, edges) {
+  build();
+}
+
+/**
+ * @brief Builds the node array. The top levels are laid out sequentially
+ * until there is one subtree per thread; the subtrees are then built in
+ * parallel (their node ranges are known up front from the depth-first
+ * layout) and the top-level bounds are filled in afterwards, bottom up.
+ */
+void EdgeBvh::build() {
+  const uint32_t n = uint32_t(clusters_.clusters().size());
+  nodes_.clear();
+  if (n == 0)
+    return;
+  nodes_.resize(2 * size_t(n) - 1);
+
+  struct Job {
+    uint32_t node, first, count;
+  };
+  std::vector<Job> jobs;
+  std::vector<uint32_t> top;
+  const size_t targetJobs = Parallel::threadCount();
+  // Split breadth first so the subtrees handed to threads are balanced.
+  std::vector<Job> frontier = {{0, 0, n}};
+  for (size_t head = 0; head < frontier.size(); ++head) {
+    Job job = frontier[head];
+    size_t pending = jobs.size() + (frontier.size() - head);
+    if (job.count == 1 || pending >= targetJobs) {
+      jobs.push_back(job);
+      continue;
+    }
+    uint32_t leftCount = job.count / 2;
+    BvhNode &node = nodes_[job.node];
+    node.firstCluster = job.first;
+    node.clusterCount = job.count;
+    node.rightChild = job.node + 2 * leftCount;
+    top.push_back(job.node);
+    frontier.push_back({job.node + 1, job.first, leftCount});
+    frontier.push_back({node.rightChild, job.first + leftCount,
+                        job.count - leftCount});
+  }
+
+  Parallel::forEachChunk(jobs.size(), jobs.size(),
+                         [&](size_t begin, size_t end, size_t) {
+                           for (size_t j = begin; j < end; ++j)
+                             buildSubtree(jobs[j].node, jobs[j].first,
+                                          jobs[j].count);
+                         });
+
+  // Children always have larger indices than their parent.
+  std::sort(top.begin(), top.end());
+  for (auto it = top.rbegin(); it != top.rend(); ++it) {
+    BvhNode &node = nodes_[*it];
+    const BvhNode &left = nodes_[*it + 1], &right = nodes_[node.rightChild];
+    node.boundsMin = minVec(left.boundsMin, right.boundsMin);
+    node.boundsMax = maxVec(left.boundsMax, right.boundsMax);
+  }
+}
+
+void EdgeBvh::buildSubtree(uint32_t index, uint32_t first, uint32_t count) {
+  BvhNode &node = nodes_[index];
+  node.firstCluster = first;
+  node.clusterCount = count;
+  if (count == 1) {
+    const EdgeCluster &cluster = clusters_.clusters()[first];
+    node.boundsMin = cluster.boundsMin;
+    node.boundsMax = cluster.boundsMax;
+    node.rightChild = 0;
+    return;
+  }
+  // The left subtree of leftCount leaves occupies 2 * leftCount - 1 nodes.
+  uint32_t leftCount = count / 2;
+  node.rightChild = index + 2 * leftCount;
+  buildSubtree(index + 1, first, leftCount);
+  buildSubtree(node.rightChild, first + leftCount, count - leftCount);
+  const BvhNode &left = nodes_[index + 1], &right = nodes_[node.rightChild];
+  node.boundsMin = minVec(left.boundsMin, right.boundsMin);
+  node.boundsMax = maxVec(left.boundsMax, right.boundsMax);
+}
+
+uint64_t EdgeBvh::meshHash(const std::vector<MiniGLM::vec3> &vertices,
+                           const std::vector<std::pair<int, int>> &edges) {
+  // FNV-1a over the raw vertex and edge data.
+  uint64_t h = 1469598103934665603ull;
+  auto mix = [&h](const void *data, size_t bytes) {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < bytes; ++i)
+      h = (h ^ p[i]) * 1099511628211ull;
+  };
+  uint64_t counts[2] = {vertices.size(), edges.size()};
+  mix(counts, sizeof(counts));
+  mix(vertices.data(), vertices.size() * sizeof(MiniGLM::vec3));
+  mix(edges.data(), edges.size() * sizeof(std::pair<int, int>));
+  return h;
+}
+
+bool EdgeBvh::save(const std::string &path, uint64_t meshHash) const {
+  std::ofstream out(path, std::ios::binary);
+  if (!out)
+    return false;
+  out.write(reinterpret_cast<const char *>(&kMagic), sizeof(kMagic));
+  out.write(reinterpret_cast<const char *>(&kVersion), sizeof(kVersion));
+  out.write(reinterpret_cast<const char *>(&meshHash), sizeof(meshHash));
+  clusters_.write(out);
+  BinaryIO::writeVector(out, nodes_);
+  return bool(out);
+}
+
+bool EdgeBvh::load(const std::string &path, uint64_t meshHash,
+                   size_t sourceEdgeCount) {
+  std::ifstream in(path, std::ios::binary);
+  uint32_t magic = 0, version = 0;
+  uint64_t hash = 0;
+  if (!in.read(reinterpret_cast<char *>(&magic), sizeof(magic)) ||
+      !in.read(reinterpret_cast<char *>(&version), sizeof(version)) ||
+      !in.read(reinterpret_cast<char *>(&hash), sizeof(hash)))
+    return false;
+  if (magic != kMagic || version != kVersion || hash != meshHash)
+    return false;
+  if (!clusters_.read(in, sourceEdgeCount) ||
+      !BinaryIO::readVector(in, nodes_))
+    return false;
+  return validLayout();
+}
+
+/**
+ * @brief Checks that the nodes have exactly the layout build() produces:
+ * every node covers the cluster run its parent assigns it, leaves hold one
+ * cluster, and inner nodes split their run at count / 2 with the right
+ * child 2 * leftCount nodes further on. That keeps every index in range
+ * and the depth within the traversal stacks.
+ */
+bool EdgeBvh::validLayout() const {
+  const size_t n = clusters_.clusters().size();
+  if (n == 0)
+    return nodes_.empty();
+  if (nodes_.size() + 1 != 2 * n)
+    return false;
+  struct Expected {
+    uint32_t node, first, count;
+  };
+  std::vector<Expected> pending = {{0, 0, uint32_t(n)}};
+  while (!pending.empty()) {
+    Expected e = pending.back();
+    pending.pop_back();
+    const BvhNode &node = nodes_[e.node];
+    if (node.firstCluster != e.first || node.clusterCount != e.count)
+      return false;
+    if (e.count == 1) {
+      if (node.rightChild != 0)
+        return false;
+      continue;
+    }
+    uint32_t leftCount = e.count / 2;
+    if (node.rightChild != e.node + 2 * leftCount)
+      return false;
+    pending.push_back({e.node + 1, e.first, leftCount});
+    pending.push_back({node.rightChild, e.first + leftCount,
+                       e.count - leftCount});
+  }
+  return true;
+}
+
+EdgeBvh EdgeBvh::loadOrBuild(const std::vector<MiniGLM::vec3> &vertices,
+                             const std::vector<std::pair<int, int>> &edges,
+                             const std::string &cachePath) {
+  if (cachePath.empty())
+    return EdgeBvh(vertices, edges);
+  uint64_t hash = meshHash(vertices, edges);
+  EdgeBvh bvh;
+  if (bvh.load(cachePath, hash, edges.size()))
+    return bvh;
+  bvh = EdgeBvh(vertices, edges);
+  if (!bvh.save(cachePath, hash))
+    std::cerr << "Could not write BVH cache " << cachePath << "\n";
+  return bvh;
+}
+
+/**
+ * @brief Walks the hierarchy, dropping nodes whose box is outside one
+ * frustum plane and emitting the whole cluster run of nodes that are
+ * completely inside without visiting their children. Clusters come out in
+ * Morton order.
+ */
+size_t EdgeBvh::cullFrustum(const MiniGLM::mat4 &mvp,
+                            std::vector<uint32_t> &visible) const {
+  visible.clear();
+  if (nodes_.empty())
+    return 0;
+  const std::vector<EdgeCluster> &clusters = clusters_.clusters();
+  size_t culledEdges = 0;
+
+  uint32_t stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    const BvhNode &node = nodes_[stack[--top]];
+    ProjectedBox box = projectBox(mvp, node.boundsMin, node.boundsMax);
+    if (box.andCode) {
+      const EdgeCluster &a = clusters[node.firstCluster];
+      const EdgeCluster &b =
+          clusters[node.firstCluster + node.clusterCount - 1];
+      culledEdges += b.firstEdge + b.edgeCount - a.firstEdge;
+    } else if (box.orCode == 0 || node.rightChild == 0) {
+      for (uint32_t c = 0; c < node.clusterCount; ++c)
+        visible.push_back(node.firstCluster + c);
+    } else {
+      stack[top++] = node.rightChild;
+      stack[top++] = uint32_t(&node - nodes_.data()) + 1;
+    }
+  }
+  return culledEdges;
+}
+
+/**
+ * @brief Picks the front-most edge passing near a pixel.
+ *
+ * Nodes are skipped when their projected box misses the pick circle or lies
+ * behind the best hit so far; boxes reaching behind the eye cannot be
+ * projected and are always entered. At the leaves each edge is clipped,
+ * projected and tested by its 2D distance to the pixel; the depth at the
+ * closest point decides between candidates.
+ */
+long EdgeBvh::pickEdge(const MiniGLM::mat4 &mvp, int width, int height,
+                       float px, float py, float radius) const {
+  if (nodes_.empty())
+    return -1;
+  const std::vector<EdgeCluster> &clusters = clusters_.clusters();
+  const std::vector<MiniGLM::vec3> &vertices = clusters_.vertices();
+  const std::vector<std::pair<int, int>> &edges = clusters_.edges();
+  auto toScreen = [&](const MiniGLM::vec4 &c) {
+    return MiniGLM::vec3((c.x / c.w * 0.5f + 0.5f) * width,
+                         (1.0f - (c.y / c.w * 0.5f + 0.5f)) * height,
+                         c.z / c.w * 0.5f + 0.5f);
+  };
+
+  Clipper clipper;
+  float bestDepth = std::numeric_limits<float>::infinity();
+  long best = -1;
+
+  struct Entry {
+    uint32_t node;
+    float depth;
+  };
+  Entry stack[64];
+  int top = 0;
+  stack[top++] = {0, 0.0f};
+  while (top > 0) {
+    Entry entry = stack[--top];
+    if (entry.depth >= bestDepth)
+      continue;
+    const BvhNode &node = nodes_[entry.node];
+
+    if (node.rightChild == 0) {
+      const EdgeCluster &cluster = clusters[node.firstCluster];
+      for (uint32_t e = cluster.firstEdge;
+           e < cluster.firstEdge + cluster.edgeCount; ++e) {
+        MiniGLM::vec4 c0 = mvp * MiniGLM::vec4(vertices[edges[e].first], 1.0f);
+        MiniGLM::vec4 c1 =
+            mvp * MiniGLM::vec4(vertices[edges[e].second], 1.0f);
+        if (!clipper.clipLineToFrustum(c0, c1))
+          continue;
+        MiniGLM::vec3 a = toScreen(c0), b = toScreen(c1);
+        float dx = b.x - a.x, dy = b.y - a.y;
+        float len2 = dx * dx + dy * dy;
+        float t = len2 > 0.0f
+                      ? std::clamp(((px - a.x) * dx + (py - a.y) * dy) / len2,
+                                   0.0f, 1.0f)
+                      : 0.0f;
+        float ex = a.x + t * dx - px, ey = a.y + t * dy - py;
+        float depth = a.z + t * (b.z - a.z);
+        if (ex * ex + ey * ey <= radius * radius && depth < bestDepth) {
+          bestDepth = depth;
+          best = long(clusters_.sourceEdge(e));
+        }
+      }
+      continue;
+    }
+
+    // Project both children; visit the nearer one first.
+    Entry children[2];
+    int count = 0;
+    for (uint32_t child : {entry.node + 1, node.rightChild}) {
+      const BvhNode &c = nodes_[child];
+      ProjectedBox box = projectBox(mvp, c.boundsMin, c.boundsMax);
+      if (box.andCode)
+        continue;
+      float minDepth = 0.0f;
+      bool projectable = true;
+      for (const MiniGLM::vec4 &p : box.corner)
+        projectable = projectable && p.w > 0.0f;
+      if (projectable) {
+        float xLo = 1e30f, xHi = -1e30f, yLo = 1e30f, yHi = -1e30f;
+        minDepth = 1e30f;
+        for (const MiniGLM::vec4 &p : box.corner) {
+          MiniGLM::vec3 s = toScreen(p);
+          xLo = std::min(xLo, s.x), xHi = std::max(xHi, s.x);
+          yLo = std::min(yLo, s.y), yHi = std::max(yHi, s.y);
+          minDepth = std::min(minDepth, s.z);
+        }
+        if (px + radius < xLo || px - radius > xHi || py + radius < yLo ||
+            py - radius > yHi)
+          continue;
+      }
+      children[count++] = {child, minDepth};
+    }
+    if (count == 2 && children[0].depth < children[1].depth)
+      std::swap(children[0], children[1]);
+    for (int i = 0; i < count; ++i)
+      stack[top++] = children[i];
+  }
+  return best;
+}
@@ -0,0 +1,158 @@
+#include "EdgeClusters.hpp"
+#include "BinaryIO.hpp"
+#include "Parallel.hpp"
+#include <algorithm>
+
+// Spreads the low 10 bits of v so there are two zero bits between each.
+static uint32_t expandBits(uint32_t v) {
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+// Edges per Morton code chunk.
+static constexpr size_t kCodeGrain = 1 << 14;
+
+/**
+ * @brief 30-bit Morton code of a point given in [0, 1]^3.
+ */
+static uint32_t morton3D(const MiniGLM::vec3 &p) {
+  auto q = [](float v) {
+    return uint32_t(std::clamp(v * 1024.0f, 0.0f, 1023.0f));
+  };
+  return (expandBits(q(p.x)) << 2) | (expandBits(q(p.y)) << 1) |
+         expandBits(q(p.z));
+}
+
+/**
+ * @brief Sorts the edges along a Morton curve through their midpoints and
+ * splits them into clusters with local vertex copies and bounding boxes.
+ *
+ * Morton codes are computed and sorted in parallel on the shared pool.
+ *
+ * @param vertices Mesh vertices.
+ * @param edges Mesh edges indexing vertices.
+ * @param clusterSize Edges per cluster (the last one may be smaller).
+ */
+EdgeClusters::EdgeClusters(const std::vector<MiniGLM::vec3> &vertices,
+                           const std::vector<std::pair<int, int>> &edges,
+                           size_t clusterSize) {
+  if (edges.empty())
+    return;
+  clusterSize = std::max<size_t>(1, clusterSize);
+
+  MiniGLM::vec3 lo = vertices[edges[0].first], hi = lo;
+  for (const MiniGLM::vec3 &v : vertices) {
+    lo = MiniGLM::vec3(std::min(lo.x, v.x), std::min(lo.y, v.y),
+                       std::min(lo.z, v.z));
+    hi = MiniGLM::vec3(std::max(hi.x, v.x), std::max(hi.y, v.y),
+                       std::max(hi.z, v.z));
+  }
+  MiniGLM::vec3 extent = hi - lo;
+  MiniGLM::vec3 invExtent(extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+                          extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                          extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+  std::vector<std::pair<uint32_t, uint32_t>> order(edges.size());
+  Parallel::parallelFor(
+      edges.size(), kCodeGrain, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+          MiniGLM::vec3 mid =
+              (vertices[edges[i].first] + vertices[edges[i].second]) * 0.5f -
+              lo;
+          MiniGLM::vec3 unit(mid.x * invExtent.x, mid.y * invExtent.y,
+                             mid.z * invExtent.z);
+          order[i] = {morton3D(unit), uint32_t(i)};
+        }
+      });
+  Parallel::sort(order.begin(), order.end());
+
+  // Global vertex index -> index in vertices_, valid for the current
+  // cluster only; reset through the touched list afterwards.
+  std::vector<int> local(vertices.size(), -1);
+  std::vector<int> touched;
+  clusters_.reserve((edges.size() + clusterSize - 1) / clusterSize);
+  edges_.reserve(edges.size());
+  sourceEdges_.reserve(edges.size());
+
+  for (size_t first = 0; first < order.size(); first += clusterSize) {
+    size_t last = std::min(order.size(), first + clusterSize);
+    EdgeCluster cluster;
+    cluster.firstVertex = uint32_t(vertices_.size());
+    cluster.firstEdge = uint32_t(edges_.size());
+    cluster.boundsMin = cluster.boundsMax =
+        vertices[edges[order[first].second].first];
+
+    auto remap = [&](int v) {
+      if (local[v] < 0) {
+        local[v] = int(vertices_.size());
+        touched.push_back(v);
+        const MiniGLM::vec3 &p = vertices[v];
+        vertices_.push_back(p);
+        cluster.boundsMin =
+            MiniGLM::vec3(std::min(cluster.boundsMin.x, p.x),
+                          std::min(cluster.boundsMin.y, p.y),
+                          std::min(cluster.boundsMin.z, p.z));
+        cluster.boundsMax =
+            MiniGLM::vec3(std::max(cluster.boundsMax.x, p.x),
+                          std::max(cluster.boundsMax.y, p.y),
+                          std::max(cluster.boundsMax.z, p.z));
+      }
+      return local[v];
+    };
+    for (size_t k = first; k < last; ++k) {
+      const std::pair<int, int> &e = edges[order[k].second];
+      int a = remap(e.first);
+      int b = remap(e.second);
+      edges_.emplace_back(a, b);
+      sourceEdges_.push_back(order[k].second);
+    }
+
+    cluster.vertexCount = uint32_t(vertices_.size()) - cluster.firstVertex;
+    cluster.edgeCount = uint32_t(last - first);
+    clusters_.push_back(cluster);
+    for (int v : touched)
+      local[v] = -1;
+    touched.clear();
+  }
+}
+
+void EdgeClusters::write(std::ostream &out) const {
+  BinaryIO::writeVector(out, clusters_);
+  BinaryIO::writeVector(out, vertices_);
+  BinaryIO::writeVector(out, edges_);
+  BinaryIO::writeVector(out, sourceEdges_);
+}
+
+/**
+ * @brief Reads what write() wrote and checks it. The file is trusted for
+ * nothing: a cluster's vertex and edge ranges must lie inside the loaded
+ * vectors, every edge endpoint inside its cluster's vertex range, and
+ * every source edge inside the mesh, so a damaged cache cannot send the
+ * renderer out of bounds.
+ */
+bool EdgeClusters::read(std::istream &in, size_t sourceEdgeCount) {
+  if (!BinaryIO::readVector(in, clusters_) ||
+      !BinaryIO::readVector(in, vertices_) ||
+      !BinaryIO::readVector(in, edges_) ||
+      !BinaryIO::readVector(in, sourceEdges_) ||
+      sourceEdges_.size() != edges_.size())
+    return false;
+  for (const EdgeCluster &c : clusters_) {
+    if (uint64_t(c.firstVertex) + c.vertexCount > vertices_.size() ||
+        uint64_t(c.firstEdge) + c.edgeCount > edges_.size())
+      return false;
+    for (uint32_t e = c.firstEdge; e < c.firstEdge + c.edgeCount; ++e) {
+      for (int v : {edges_[e].first, edges_[e].second})
+        if (v < int64_t(c.firstVertex) ||
+            v >= int64_t(c.firstVertex) + c.vertexCount)
+          return false;
+    }
+  }
+  for (uint32_t source : sourceEdges_)
+    if (source >= sourceEdgeCount)
+      return false;
+  return true;
+}
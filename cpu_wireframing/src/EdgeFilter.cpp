@@ -0,0 +1,107 @@
+#include "EdgeFilter.hpp"
+#include "Parallel.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief Splits the face planes into padded SoA arrays and reorders the
+ * edge adjacency to match the clustered edge order.
+ *
+ * @param facePlanes Plane (unit normal, offset) of every face.
+ * @param edgeFaces Adjacent faces of every source edge, -1 if unknown.
+ * @param clusters Clustered edges whose order culled() follows.
+ */
+EdgeFilter::EdgeFilter(const std::vector<MiniGLM::vec4> &facePlanes,
+                       const std::vector<std::pair<int, int>> &edgeFaces,
+                       const EdgeClusters &clusters)
+    : faceCount_(facePlanes.size()) {
+  // The padding lanes are zero planes, which never count as back-facing.
+  size_t padded = (faceCount_ + 3) & ~size_t(3);
+  nx_.assign(padded, 0.0f);
+  ny_.assign(padded, 0.0f);
+  nz_.assign(padded, 0.0f);
+  d_.assign(padded, 0.0f);
+  for (size_t f = 0; f < faceCount_; ++f) {
+    nx_[f] = facePlanes[f].x;
+    ny_[f] = facePlanes[f].y;
+    nz_[f] = facePlanes[f].z;
+    d_[f] = facePlanes[f].w;
+  }
+  back_.assign(std::max(padded, faceCount_ + 1), 0);
+
+  const uint32_t sentinel = uint32_t(faceCount_);
+  edgeFaces_.resize(clusters.edges().size());
+  for (size_t i = 0; i < edgeFaces_.size(); ++i) {
+    const std::pair<int, int> &f = edgeFaces[clusters.sourceEdge(i)];
+    if (f.first < 0 || f.second < 0)
+      edgeFaces_[i] = {sentinel, sentinel};
+    else
+      edgeFaces_[i] = {uint32_t(f.first), uint32_t(f.second)};
+  }
+  feature_.assign(edgeFaces_.size(), 0);
+}
+
+/**
+ * @brief Switches outline mode and, when enabling it, marks the feature
+ * edges: creases between faces whose normals are more than creaseDegrees
+ * apart, boundaries (one face) and edges with unknown adjacency.
+ */
+void EdgeFilter::setOutlineOnly(bool enabled, float creaseDegrees) {
+  outlineOnly_ = enabled;
+  if (!enabled)
+    return;
+  const float cosCrease = std::cos(MiniGLM::radians(creaseDegrees));
+  const uint32_t sentinel = uint32_t(faceCount_);
+  for (size_t i = 0; i < edgeFaces_.size(); ++i) {
+    uint32_t f0 = edgeFaces_[i].first, f1 = edgeFaces_[i].second;
+    if (f0 == f1 || f0 == sentinel) {
+      feature_[i] = 1;
+      continue;
+    }
+    float cosAngle =
+        nx_[f0] * nx_[f1] + ny_[f0] * ny_[f1] + nz_[f0] * nz_[f1];
+    feature_[i] = uint8_t(cosAngle < cosCrease);
+  }
+}
+
+/**
+ * @brief Recomputes the back-facing flag of every face: a face is turned
+ * away when the eye lies behind its plane. The sweep runs four faces per
+ * SSE2 step, split across threads for large meshes.
+ */
+void EdgeFilter::update(const MiniGLM::vec4 &eye) {
+  const size_t blocks = nx_.size() / 4;
+  // Only large meshes are worth waking threads for.
+  constexpr size_t kBlocksPerThread = 4096;
+  size_t chunks = std::min(Parallel::threadCount(),
+                           blocks / kBlocksPerThread + 1);
+
+  auto sweep = [&](size_t begin, size_t end, size_t) {
+#if defined(__SSE2__)
+    const __m128 ex = _mm_set1_ps(eye.x), ey = _mm_set1_ps(eye.y);
+    const __m128 ez = _mm_set1_ps(eye.z), ew = _mm_set1_ps(eye.w);
+    const __m128 zero = _mm_setzero_ps();
+    for (size_t b = begin; b < end; ++b) {
+      size_t f = b * 4;
+      __m128 dist = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&nx_[f]), ex),
+                     _mm_mul_ps(_mm_loadu_ps(&ny_[f]), ey)),
+          _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&nz_[f]), ez),
+                     _mm_mul_ps(_mm_loadu_ps(&d_[f]), ew)));
+      int mask = _mm_movemask_ps(_mm_cmplt_ps(dist, zero));
+      for (int l = 0; l < 4; ++l)
+        back_[f + l] = uint8_t((mask >> l) & 1);
+    }
+#else
+    for (size_t f = begin * 4; f < end * 4; ++f)
+      back_[f] = uint8_t(nx_[f] * eye.x + ny_[f] * eye.y + nz_[f] * eye.z +
+                             d_[f] * eye.w <
+                         0.0f);
+#endif
+  };
+  Parallel::forEachChunk(blocks, chunks, sweep);
+}
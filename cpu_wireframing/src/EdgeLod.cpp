@@ -0,0 +1,146 @@
+#include "EdgeLod.hpp"
+#include "Parallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+
+// Simplified levels of a run of clusters, with indices local to the run.
+struct LodChunk {
+  std::vector<LodLevel> levels;
+  std::vector<MiniGLM::vec3> vertices;
+  std::vector<std::pair<int, int>> edges;
+};
+
+// Packs a grid cell into one key; 21 bits per axis.
+uint64_t cellKey(int64_t x, int64_t y, int64_t z) {
+  const uint64_t mask = (uint64_t(1) << 21) - 1;
+  return ((uint64_t(x) & mask) << 42) | ((uint64_t(y) & mask) << 21) |
+         (uint64_t(z) & mask);
+}
+
+} // namespace
+
+/**
+ * @brief Builds kLevels simplified versions of every cluster. The base cell
+ * is the mean edge length; clusters are simplified in parallel, each thread
+ * handling a contiguous run whose output is appended in order afterwards.
+ */
+EdgeLod::EdgeLod(const EdgeClusters &clusters) {
+  const std::vector<EdgeCluster> &source = clusters.clusters();
+  const std::vector<MiniGLM::vec3> &vertices = clusters.vertices();
+  const std::vector<std::pair<int, int>> &edges = clusters.edges();
+  if (edges.empty())
+    return;
+
+  double total = 0.0;
+  for (const auto &e : edges)
+    total += MiniGLM::length(vertices[e.second] - vertices[e.first]);
+  baseCell_ = float(total / double(edges.size()));
+  if (!(baseCell_ > 0.0f))
+    return;
+
+  const size_t chunks = std::min(Parallel::threadCount(), source.size());
+  std::vector<LodChunk> out(chunks);
+  Parallel::forEachChunk(
+      source.size(), chunks, [&](size_t begin, size_t end, size_t chunk) {
+        LodChunk &lod = out[chunk];
+        std::unordered_map<uint64_t, int> cells;
+        std::vector<std::pair<int, int>> snapped;
+        std::vector<int> local;
+        for (size_t c = begin; c < end; ++c) {
+          const EdgeCluster &cluster = source[c];
+          local.resize(cluster.vertexCount);
+          for (int k = 1; k <= kLevels; ++k) {
+            const float cell = cellSize(k), invCell = 1.0f / cell;
+            LodLevel level;
+            level.firstVertex = uint32_t(lod.vertices.size());
+            level.firstEdge = uint32_t(lod.edges.size());
+            cells.clear();
+            for (uint32_t v = 0; v < cluster.vertexCount; ++v) {
+              const MiniGLM::vec3 &p = vertices[cluster.firstVertex + v];
+              int64_t x = int64_t(std::floor(p.x * invCell));
+              int64_t y = int64_t(std::floor(p.y * invCell));
+              int64_t z = int64_t(std::floor(p.z * invCell));
+              auto inserted =
+                  cells.emplace(cellKey(x, y, z), int(lod.vertices.size()));
+              if (inserted.second)
+                lod.vertices.emplace_back((float(x) + 0.5f) * cell,
+                                          (float(y) + 0.5f) * cell,
+                                          (float(z) + 0.5f) * cell);
+              local[v] = inserted.first->second;
+            }
+            snapped.clear();
+            for (uint32_t e = 0; e < cluster.edgeCount; ++e) {
+              const auto &edge = edges[cluster.firstEdge + e];
+              int a = local[edge.first - int(cluster.firstVertex)];
+              int b = local[edge.second - int(cluster.firstVertex)];
+              if (a != b)
+                snapped.emplace_back(std::min(a, b), std::max(a, b));
+            }
+            std::sort(snapped.begin(), snapped.end());
+            snapped.erase(std::unique(snapped.begin(), snapped.end()),
+                          snapped.end());
+            lod.edges.insert(lod.edges.end(), snapped.begin(), snapped.end());
+            level.vertexCount =
+                uint32_t(lod.vertices.size()) - level.firstVertex;
+            level.edgeCount = uint32_t(snapped.size());
+            lod.levels.push_back(level);
+          }
+        }
+      });
+
+  for (LodChunk &lod : out) {
+    const uint32_t vertexBase = uint32_t(vertices_.size());
+    const uint32_t edgeBase = uint32_t(edges_.size());
+    for (LodLevel level : lod.levels) {
+      level.firstVertex += vertexBase;
+      level.firstEdge += edgeBase;
+      levels_.push_back(level);
+    }
+    for (const auto &e : lod.edges)
+      edges_.emplace_back(e.first + int(vertexBase),
+                          e.second + int(vertexBase));
+    vertices_.insert(vertices_.end(), lod.vertices.begin(),
+                     lod.vertices.end());
+  }
+}
+
+/**
+ * @brief Estimates how many pixels one model-space unit covers inside the
+ * cluster's box and returns the coarsest level whose cell stays within
+ * maxError pixels.
+ *
+ * The scale is the first-order screen-space derivative at the box corner
+ * nearest to the eye (smallest clip w). Boxes reaching the eye plane always
+ * get full detail.
+ */
+int EdgeLod::selectLevel(const MiniGLM::mat4 &mvp, int width, int height,
+                         const EdgeCluster &cluster, float maxError) const {
+  if (levels_.empty())
+    return 0;
+  float minW = std::numeric_limits<float>::infinity();
+  for (int i = 0; i < 8; ++i) {
+    MiniGLM::vec3 p(i & 1 ? cluster.boundsMax.x : cluster.boundsMin.x,
+                    i & 2 ? cluster.boundsMax.y : cluster.boundsMin.y,
+                    i & 4 ? cluster.boundsMax.z : cluster.boundsMin.z);
+    minW = std::min(minW, mvp.at(0, 3) * p.x + mvp.at(1, 3) * p.y +
+                              mvp.at(2, 3) * p.z + mvp.at(3, 3));
+  }
+  if (!(minW > 1e-6f))
+    return 0;
+  auto rowLength = [&](int row) {
+    return MiniGLM::length(
+        MiniGLM::vec3(mvp.at(0, row), mvp.at(1, row), mvp.at(2, row)));
+  };
+  float pixelsPerUnit =
+      0.5f * std::max(width * rowLength(0), height * rowLength(1)) / minW;
+  float baseError = baseCell_ * pixelsPerUnit;
+  if (!(baseError > 0.0f))
+    return 0;
+  // cellSize(k) * pixelsPerUnit = baseError * 2^k <= maxError.
+  int level = int(std::floor(std::log2(maxError / baseError)));
+  return std::clamp(level, 0, kLevels);
+}
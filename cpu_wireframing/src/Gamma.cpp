@@ -0,0 +1,37 @@
+#include "Gamma.hpp"
+#include <cmath>
+
+/**
+ * @brief Builds the sRGB <-> linear lookup tables.
+ *
+ * Uses the exact piecewise sRGB transfer function. This is the only place
+ * pow() is called; blending itself is table lookups and integer math.
+ */
+static Gamma::Tables buildTables() {
+  Gamma::Tables t;
+  const double scale = double(255 << Gamma::kLinearShift);
+  for (int i = 0; i < 256; ++i) {
+    double c = i / 255.0;
+    double lin = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+    t.toLinear[i] = static_cast<uint16_t>(std::lround(lin * scale));
+  }
+  const int entries = sizeof(t.toSrgb);
+  for (int i = 0; i < entries; ++i) {
+    // Sample the middle of the bucket so decode -> encode round-trips.
+    double lin =
+        (double(i << Gamma::kEncodeShift) + (1 << Gamma::kEncodeShift) / 2) /
+        scale;
+    double c = lin <= 0.0031308 ? lin * 12.92
+                                : 1.055 * std::pow(lin, 1.0 / 2.4) - 0.055;
+    t.toSrgb[i] = static_cast<uint8_t>(std::lround(std::fmin(c, 1.0) * 255.0));
+  }
+  return t;
+}
+
+/**
+ * @brief Returns the process-wide tables, built on first use.
+ */
+const Gamma::Tables &Gamma::tables() {
+  static const Tables t = buildTables();
+  return t;
+}
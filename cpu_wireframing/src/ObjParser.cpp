@@ -1,14 +1,39 @@
 #include "ObjParser.hpp"
+#include "Parallel.hpp"
+#include "TaskGraph.hpp"
 
 #include <algorithm>
 #include <fstream>
 #include <iostream>
-#include <set>
 #include <sstream>
+#include <tuple>
+
+// Bytes of the file per parse task; blocks end at a line break.
+static constexpr size_t kParseBlock = 1 << 18;
+// Faces per chunk of edge and plane extraction.
+static constexpr size_t kFaceGrain = 1 << 13;
+
+// What the lines of one block parsed to. Face indices are only checked
+// once the number of vertices in the blocks before is known.
+struct ObjParser::ParsedBlock {
+  struct FaceLine {
+    size_t verticesBefore; // vertices of this block above the face
+    size_t begin, end;     // line in the file text, for the warning
+    int minIndex, maxIndex;
+  };
+  std::vector<MiniGLM::vec3> vertices;
+  std::vector<Face> faces;
+  std::vector<FaceLine> faceLines;
+};
 
 /**
  * @brief Function to load and store data from the obj file and extract edges.
  *
+ * The file is read at once and cut into blocks of whole lines that are
+ * parsed in parallel; the blocks are then joined in file order, so the
+ * result and the warnings are the same as for a line by line read. Edge
+ * extraction and face planes run as two tasks of one graph.
+ *
  * @param filename .obj filename
  * @return true
  * @return false
@@ -21,13 +46,71 @@ bool ObjParser::load(const std::string &filename) {
     return false;
   }
 
-  std::ifstream infile(filename);
+  std::ifstream infile(filename, std::ios::binary);
   if (!infile)
     return false;
+  std::string text;
+  infile.seekg(0, std::ios::end);
+  text.resize(size_t(std::max<std::streamoff>(0, infile.tellg())));
+  infile.seekg(0, std::ios::beg);
+  if (!infile.read(&text[0], std::streamsize(text.size())))
+    return false;
 
-  std::string line;
-  while (std::getline(infile, line)) {
-    std::istringstream iss(line);
+  std::vector<std::pair<size_t, size_t>> blocks;
+  for (size_t begin = 0; begin < text.size();) {
+    size_t end = begin + kParseBlock;
+    if (end >= text.size())
+      end = text.size();
+    else if ((end = text.find('\n', end)) == std::string::npos)
+      end = text.size();
+    else
+      ++end;
+    blocks.emplace_back(begin, end);
+    begin = end;
+  }
+  std::vector<ParsedBlock> parsed(blocks.size());
+  Parallel::parallelFor(blocks.size(), 1,
+                        [&](size_t begin, size_t end, size_t) {
+                          for (size_t b = begin; b < end; ++b)
+                            parse_lines(text, blocks[b].first,
+                                        blocks[b].second, parsed[b]);
+                        });
+
+  for (ParsedBlock &block : parsed) {
+    const size_t before = vertices.size();
+    vertices.insert(vertices.end(), block.vertices.begin(),
+                    block.vertices.end());
+    for (size_t f = 0; f < block.faces.size(); ++f) {
+      const ParsedBlock::FaceLine &line = block.faceLines[f];
+      if (line.minIndex >= 0 &&
+          size_t(line.maxIndex) < before + line.verticesBefore) {
+        faces.push_back(std::move(block.faces[f]));
+      } else {
+        std::cerr << "Warning: Face references nonexistent vertex in line: "
+                  << text.substr(line.begin, line.end - line.begin)
+                  << std::endl;
+      }
+    }
+    block = ParsedBlock();
+  }
+
+  TaskGraph graph;
+  graph.add([this] { extract_edges(); });
+  graph.add([this] { compute_face_planes(); });
+  graph.run();
+  return true;
+}
+
+/**
+ * @brief Parses the lines in text[begin, end) into out.
+ */
+void ObjParser::parse_lines(const std::string &text, size_t begin, size_t end,
+                            ParsedBlock &out) const {
+  while (begin < end) {
+    size_t lineEnd = text.find('\n', begin);
+    if (lineEnd == std::string::npos || lineEnd > end)
+      lineEnd = end;
+    std::istringstream iss(text.substr(begin, lineEnd - begin));
     std::string prefix;
     iss >> prefix;
 
@@ -37,7 +120,7 @@ bool ObjParser::load(const std::string &filename) {
       while (iss >> temp)
         tokens.push_back(temp);
       if (validate_vertex(tokens)) {
-        vertices.push_back(MiniGLM::vec3(
+        out.vertices.push_back(MiniGLM::vec3(
             std::stof(tokens[0]), std::stof(tokens[1]), std::stof(tokens[2])));
       }
     } else if (prefix == "f") {
@@ -52,17 +135,15 @@ bool ObjParser::load(const std::string &filename) {
           int idx = std::stoi(vert.substr(0, slash)) - 1;
           face.vertex_indices.push_back(idx);
         }
-        if (is_valid_face_indices(face.vertex_indices)) {
-          faces.push_back(face);
-        } else {
-          std::cerr << "Warning: Face references nonexistent vertex in line: "
-                    << line << std::endl;
-        }
+        const auto &idx = face.vertex_indices;
+        out.faceLines.push_back({out.vertices.size(), begin, lineEnd,
+                                 *std::min_element(idx.begin(), idx.end()),
+                                 *std::max_element(idx.begin(), idx.end())});
+        out.faces.push_back(std::move(face));
       }
     }
+    begin = lineEnd + 1;
   }
-  extract_edges();
-  return true;
 }
 
 /**
@@ -72,7 +153,7 @@ bool ObjParser::load(const std::string &filename) {
  * @return true
  * @return false when the token is anything other than a float
  */
-bool ObjParser::validate_vertex(const std::vector<std::string> tokens) {
+bool ObjParser::validate_vertex(const std::vector<std::string> tokens) const {
   if (tokens.size() != 3)
     return false;
   try {
@@ -93,7 +174,7 @@ bool ObjParser::validate_vertex(const std::vector<std::string> tokens) {
  * @return true if valid
  * @return false if not valid
  */
-bool ObjParser::validate_face(const std::vector<std::string> tokens) {
+bool ObjParser::validate_face(const std::vector<std::string> tokens) const {
   if (tokens.size() < 3) {
     return false;
   }
@@ -109,42 +190,105 @@ bool ObjParser::validate_face(const std::vector<std::string> tokens) {
 }
 
 /**
- * @brief simply checks if the indices in the face exist.
+ * @brief Splits every face into a triangle fan.
  *
- * @param indices
- * @return true
- * @return false
+ * @return Three vertex indices per triangle, flattened.
  */
-bool ObjParser::is_valid_face_indices(const std::vector<int> &indices) {
-  for (int idx : indices) {
-    if (idx < 0 || idx >= static_cast<int>(vertices.size())) {
-      return false;
+std::vector<int> ObjParser::triangulateFaces() const {
+  std::vector<int> triangles;
+  for (const auto &face : faces) {
+    const auto &idx = face.vertex_indices;
+    for (size_t i = 1; i + 1 < idx.size(); ++i) {
+      triangles.push_back(idx[0]);
+      triangles.push_back(idx[i]);
+      triangles.push_back(idx[i + 1]);
     }
   }
-  return true;
+  return triangles;
 }
 
 /**
- * @brief find al unique edges using set and store them in the edges variable
+ * @brief find al unique edges and store them in the edges variable, together
+ * with the (up to two) faces adjacent to each.
  *
+ * Every face side becomes a (sorted endpoints, face) record; the records are
+ * filled and sorted in parallel, so equal edges end up next to each other
+ * with their faces in ascending order.
  */
 void ObjParser::extract_edges() {
   edges.clear();
-  std::set<std::pair<int, int>> uniqueEdges;
+  edgeFaces.clear();
+  struct Side {
+    int v0, v1, face;
+    bool operator<(const Side &o) const {
+      return std::tie(v0, v1, face) < std::tie(o.v0, o.v1, o.face);
+    }
+  };
+  std::vector<size_t> firstSide(faces.size() + 1, 0);
+  for (size_t f = 0; f < faces.size(); ++f)
+    firstSide[f + 1] = firstSide[f] + faces[f].vertex_indices.size();
+  std::vector<Side> sides(firstSide.back());
+  Parallel::parallelFor(
+      faces.size(), kFaceGrain, [&](size_t begin, size_t end, size_t) {
+        for (size_t f = begin; f < end; ++f) {
+          const std::vector<int> &idx = faces[f].vertex_indices;
+          const size_t n = idx.size();
+          for (size_t i = 0; i < n; ++i) {
+            int v1 = idx[i], v2 = idx[(i + 1) % n];
+            // Store edges in sorted order to avoid duplicates (1,3) == (3,1)
+            sides[firstSide[f] + i] = {std::min(v1, v2), std::max(v1, v2),
+                                       int(f)};
+          }
+        }
+      });
+  Parallel::sort(sides.begin(), sides.end());
 
-  for (const auto &face : faces) {
-    int n = face.vertex_indices.size();
-    for (int i = 0; i < n; ++i) {
-      int v1 = face.vertex_indices[i];
-      int v2 = face.vertex_indices[(i + 1) % n];
-      // Store edges in sorted order to avoid duplicates (1,3) == (3,1)
-      int minV = std::min(v1, v2);
-      int maxV = std::max(v1, v2);
-      uniqueEdges.insert({minV, maxV});
+  for (size_t i = 0; i < sides.size();) {
+    const Side &edge = sides[i];
+    int first = -1, second = -1, count = 0;
+    for (; i < sides.size() && sides[i].v0 == edge.v0 &&
+           sides[i].v1 == edge.v1;
+         ++i) {
+      int f = sides[i].face;
+      if (count > 0 && f == (count == 1 ? first : second))
+        continue; // face lists the same edge twice
+      (count == 0 ? first : second) = f;
+      ++count;
     }
+    edges.emplace_back(edge.v0, edge.v1);
+    if (count == 1)
+      edgeFaces.emplace_back(first, first);
+    else if (count == 2)
+      edgeFaces.emplace_back(first, second);
+    else
+      edgeFaces.emplace_back(-1, -1);
   }
+}
 
-  for (const auto &e : uniqueEdges) {
-    edges.push_back(e);
-  }
+/**
+ * @brief Computes the plane of every face. The normal is found with
+ * Newell's method, which also handles non-planar polygons, and the plane
+ * passes through the face centroid. Degenerate faces get a zero plane.
+ */
+void ObjParser::compute_face_planes() {
+  facePlanes.assign(faces.size(), MiniGLM::vec4(0.0f));
+  Parallel::parallelFor(
+      faces.size(), kFaceGrain, [&](size_t begin, size_t end, size_t) {
+        for (size_t f = begin; f < end; ++f) {
+          const auto &idx = faces[f].vertex_indices;
+          MiniGLM::vec3 normal(0.0f), centroid(0.0f);
+          for (size_t i = 0; i < idx.size(); ++i) {
+            const MiniGLM::vec3 &a = vertices[idx[i]];
+            const MiniGLM::vec3 &b = vertices[idx[(i + 1) % idx.size()]];
+            normal.x += (a.y - b.y) * (a.z + b.z);
+            normal.y += (a.z - b.z) * (a.x + b.x);
+            normal.z += (a.x - b.x) * (a.y + b.y);
+            centroid += a;
+          }
+          normal = MiniGLM::normalize(normal);
+          centroid = centroid / float(idx.size());
+          facePlanes[f] =
+              MiniGLM::vec4(normal, -MiniGLM::dot(normal, centroid));
+        }
+      });
 }
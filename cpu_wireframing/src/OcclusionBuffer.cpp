@@ -0,0 +1,293 @@
+#include "OcclusionBuffer.hpp"
+#include "ObjParser.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+
+/**
+ * @brief Keeps a private copy of the occluder geometry.
+ *
+ * @param vertices Occluder vertices in model space.
+ * @param triangles Three indices into vertices per triangle.
+ */
+OcclusionBuffer::OcclusionBuffer(const std::vector<MiniGLM::vec3> &vertices,
+                                 const std::vector<int> &triangles)
+    : vertices_(vertices), clip_(vertices.size()),
+      cellFar_(size_t(kWidth) * kHeight,
+               std::numeric_limits<float>::infinity()) {
+  mergeQuads(triangles);
+}
+
+/**
+ * @brief Pairs each triangle with a neighbour across one of its edges when
+ * the two are coplanar, wound alike and form a strictly convex quad.
+ *
+ * Neither half of a quad covers the cells along its diagonal on its own, so
+ * without merging every quad occluder would leave a band of open cells.
+ */
+void OcclusionBuffer::mergeQuads(const std::vector<int> &triangles) {
+  const size_t triCount = triangles.size() / 3;
+  auto key = [](int from, int to) {
+    return uint64_t(uint32_t(from)) << 32 | uint32_t(to);
+  };
+  std::unordered_map<uint64_t, uint32_t> byEdge;
+  byEdge.reserve(triCount * 3);
+  for (size_t t = 0; t < triCount; ++t)
+    for (int i = 0; i < 3; ++i)
+      byEdge.emplace(key(triangles[t * 3 + i], triangles[t * 3 + (i + 1) % 3]),
+                     uint32_t(t));
+
+  auto convexPlanar = [&](const int (&q)[4], const MiniGLM::vec3 &normal) {
+    for (int k = 0; k < 4; ++k) {
+      const MiniGLM::vec3 &a = vertices_[q[k]];
+      const MiniGLM::vec3 &b = vertices_[q[(k + 1) % 4]];
+      const MiniGLM::vec3 &c = vertices_[q[(k + 2) % 4]];
+      MiniGLM::vec3 turn = MiniGLM::cross(b - a, c - b);
+      float along = MiniGLM::dot(turn, normal);
+      // Every corner turns the same way and the turn is parallel to the
+      // normal up to 1e-4 radians.
+      if (!(along > 0.0f) ||
+          MiniGLM::length(MiniGLM::cross(turn, normal)) > 1e-4f * along)
+        return false;
+    }
+    return true;
+  };
+
+  std::vector<char> used(triCount, 0);
+  polygons_.reserve(triCount * 4);
+  for (size_t t = 0; t < triCount; ++t) {
+    if (used[t])
+      continue;
+    used[t] = 1;
+    const int *v = &triangles[t * 3];
+    int polygon[4] = {v[0], v[1], v[2], -1};
+    MiniGLM::vec3 normal =
+        MiniGLM::cross(vertices_[v[1]] - vertices_[v[0]],
+                       vertices_[v[2]] - vertices_[v[0]]);
+    for (int i = 0; i < 3 && polygon[3] < 0; ++i) {
+      int a = v[i], b = v[(i + 1) % 3], c = v[(i + 2) % 3];
+      auto it = byEdge.find(key(b, a));
+      if (it == byEdge.end() || used[it->second])
+        continue;
+      const int *w = &triangles[size_t(it->second) * 3];
+      int d = -1;
+      for (int k = 0; k < 3; ++k)
+        if (w[k] != a && w[k] != b)
+          d = w[k];
+      int quad[4] = {a, d, b, c};
+      if (d >= 0 && convexPlanar(quad, normal)) {
+        std::copy(quad, quad + 4, polygon);
+        used[it->second] = 1;
+      }
+    }
+    polygons_.insert(polygons_.end(), polygon, polygon + 4);
+  }
+}
+
+/**
+ * @brief Picks the count largest triangles by area and compacts the
+ * vertices they use.
+ */
+std::unique_ptr<OcclusionBuffer>
+OcclusionBuffer::largestFaces(const std::vector<MiniGLM::vec3> &vertices,
+                              const std::vector<int> &triangles,
+                              size_t count) {
+  const size_t triCount = triangles.size() / 3;
+  std::vector<std::pair<float, uint32_t>> byArea(triCount);
+  for (size_t t = 0; t < triCount; ++t) {
+    const MiniGLM::vec3 &a = vertices[triangles[t * 3 + 0]];
+    const MiniGLM::vec3 &b = vertices[triangles[t * 3 + 1]];
+    const MiniGLM::vec3 &c = vertices[triangles[t * 3 + 2]];
+    byArea[t] = {-MiniGLM::length(MiniGLM::cross(b - a, c - a)),
+                 uint32_t(t)};
+  }
+  count = std::min(count, triCount);
+  std::nth_element(byArea.begin(), byArea.begin() + count, byArea.end());
+
+  std::vector<int> remap(vertices.size(), -1);
+  std::vector<MiniGLM::vec3> occluderVertices;
+  std::vector<int> occluderTriangles;
+  occluderTriangles.reserve(count * 3);
+  for (size_t k = 0; k < count; ++k) {
+    for (int i = 0; i < 3; ++i) {
+      int v = triangles[byArea[k].second * 3 + i];
+      if (remap[v] < 0) {
+        remap[v] = int(occluderVertices.size());
+        occluderVertices.push_back(vertices[v]);
+      }
+      occluderTriangles.push_back(remap[v]);
+    }
+  }
+  return std::make_unique<OcclusionBuffer>(occluderVertices,
+                                           occluderTriangles);
+}
+
+std::unique_ptr<OcclusionBuffer>
+OcclusionBuffer::load(const std::string &path) {
+  ObjParser parser;
+  if (!parser.load(path)) {
+    std::cerr << "Could not load occluders from " << path << "\n";
+    return nullptr;
+  }
+  return std::make_unique<OcclusionBuffer>(parser.vertices,
+                                           parser.triangulateFaces());
+}
+
+/**
+ * @brief Clears the cells and rasterizes every occluder polygon into them.
+ */
+void OcclusionBuffer::render(const MiniGLM::mat4 &mvp) {
+  for (size_t i = 0; i < vertices_.size(); ++i)
+    clip_[i] = mvp * MiniGLM::vec4(vertices_[i], 1.0f);
+  std::fill(cellFar_.begin(), cellFar_.end(),
+            std::numeric_limits<float>::infinity());
+  for (size_t p = 0; p < polygons_.size(); p += 4) {
+    int count = polygons_[p + 3] < 0 ? 3 : 4;
+    MiniGLM::vec4 corners[4];
+    for (int i = 0; i < count; ++i)
+      corners[i] = clip_[polygons_[p + i]];
+    rasterizeCells(corners, count);
+  }
+}
+
+/**
+ * @brief Writes one convex planar polygon into the cells it covers
+ * completely.
+ *
+ * The polygon is clipped against w >= kNearW, which keeps it convex and
+ * adds at most one vertex. Every edge function is affine, so its minimum
+ * over a cell sits at the corner picked by the signs of its gradient; the
+ * cell is inside the polygon when all those minima are non-negative. The
+ * depth written is the plane's maximum over the cell, found the same way.
+ */
+void OcclusionBuffer::rasterizeCells(const MiniGLM::vec4 *corners,
+                                     int count) {
+  MiniGLM::vec4 poly[5];
+  int n = 0;
+  for (int i = 0; i < count; ++i) {
+    const MiniGLM::vec4 &a = corners[i];
+    const MiniGLM::vec4 &b = corners[(i + 1) % count];
+    bool aIn = a.w >= kNearW, bIn = b.w >= kNearW;
+    if (aIn)
+      poly[n++] = a;
+    if (aIn != bIn)
+      poly[n++] = a + (b - a) * ((kNearW - a.w) / (b.w - a.w));
+  }
+  if (n < 3)
+    return;
+
+  double sx[5], sy[5], sz[5];
+  for (int i = 0; i < n; ++i) {
+    double invW = 1.0 / poly[i].w;
+    sx[i] = (poly[i].x * invW * 0.5 + 0.5) * kWidth;
+    sy[i] = (1.0 - (poly[i].y * invW * 0.5 + 0.5)) * kHeight;
+    sz[i] = poly[i].z * invW * 0.5 + 0.5;
+  }
+
+  // Depth plane from the fan triangle with the largest area.
+  int k = 1;
+  double area = 0.0;
+  for (int i = 1; i + 1 < n; ++i) {
+    double a = (sx[i] - sx[0]) * (sy[i + 1] - sy[0]) -
+               (sy[i] - sy[0]) * (sx[i + 1] - sx[0]);
+    if (std::fabs(a) > std::fabs(area))
+      k = i, area = a;
+  }
+  if (!(std::fabs(area) > 1e-9))
+    return;
+  double dzdx = ((sz[k] - sz[0]) * (sy[k + 1] - sy[0]) -
+                 (sy[k] - sy[0]) * (sz[k + 1] - sz[0])) /
+                area;
+  double dzdy = ((sx[k] - sx[0]) * (sz[k + 1] - sz[0]) -
+                 (sz[k] - sz[0]) * (sx[k + 1] - sx[0])) /
+                area;
+  // Farthest depth over the cell [x, x + 1] x [y, y + 1].
+  double zc = sz[0] - dzdx * sx[0] - dzdy * sy[0] + std::max(dzdx, 0.0) +
+              std::max(dzdy, 0.0) + kDepthBias;
+
+  // E(x, y) = A * x + B * y + C, positive inside, minimized over the cell.
+  double sign = area > 0.0 ? 1.0 : -1.0;
+  double A[5], B[5], C[5];
+  for (int i = 0; i < n; ++i) {
+    int j = (i + 1) % n;
+    A[i] = -(sy[j] - sy[i]) * sign;
+    B[i] = (sx[j] - sx[i]) * sign;
+    C[i] = -A[i] * sx[i] - B[i] * sy[i] + std::min(A[i], 0.0) +
+           std::min(B[i], 0.0);
+  }
+
+  double minXf = std::max(0.0, std::floor(*std::min_element(sx, sx + n)));
+  double maxXf = std::min(double(kWidth - 1),
+                          std::ceil(*std::max_element(sx, sx + n)) - 1.0);
+  double minYf = std::max(0.0, std::floor(*std::min_element(sy, sy + n)));
+  double maxYf = std::min(double(kHeight - 1),
+                          std::ceil(*std::max_element(sy, sy + n)) - 1.0);
+  if (minXf > maxXf || minYf > maxYf)
+    return;
+  for (int y = int(minYf); y <= int(maxYf); ++y) {
+    float *row = cellFar_.data() + size_t(y) * kWidth;
+    for (int x = int(minXf); x <= int(maxXf); ++x) {
+      bool covered = true;
+      for (int i = 0; i < n && covered; ++i)
+        covered = A[i] * x + B[i] * y + C[i] >= 0.0;
+      if (covered)
+        row[x] = std::min(row[x], float(dzdx * x + dzdy * y + zc));
+    }
+  }
+}
+
+/**
+ * @brief Projects the box corners; boxes reaching the near plane are never
+ * occluded. Otherwise every cell under the screen rectangle must hold an
+ * occluder strictly nearer than the nearest corner.
+ */
+bool OcclusionBuffer::occluded(const MiniGLM::mat4 &mvp,
+                               const MiniGLM::vec3 &boundsMin,
+                               const MiniGLM::vec3 &boundsMax) const {
+  float xLo = std::numeric_limits<float>::infinity(), xHi = -xLo;
+  float yLo = xLo, yHi = -xLo, zMin = xLo;
+  for (int i = 0; i < 8; ++i) {
+    MiniGLM::vec3 p(i & 1 ? boundsMax.x : boundsMin.x,
+                    i & 2 ? boundsMax.y : boundsMin.y,
+                    i & 4 ? boundsMax.z : boundsMin.z);
+    MiniGLM::vec4 c = mvp * MiniGLM::vec4(p, 1.0f);
+    if (!(c.w > kNearW))
+      return false;
+    float sx = (c.x / c.w * 0.5f + 0.5f) * kWidth;
+    float sy = (1.0f - (c.y / c.w * 0.5f + 0.5f)) * kHeight;
+    xLo = std::min(xLo, sx), xHi = std::max(xHi, sx);
+    yLo = std::min(yLo, sy), yHi = std::max(yHi, sy);
+    zMin = std::min(zMin, c.z / c.w * 0.5f + 0.5f);
+  }
+  int x0 = std::max(0, int(std::floor(xLo)));
+  int x1 = std::min(kWidth - 1, int(std::floor(xHi)));
+  int y0 = std::max(0, int(std::floor(yLo)));
+  int y1 = std::min(kHeight - 1, int(std::floor(yHi)));
+  if (x0 > x1 || y0 > y1)
+    return false;
+  for (int y = y0; y <= y1; ++y) {
+    const float *row = cellFar_.data() + size_t(y) * kWidth;
+    for (int x = x0; x <= x1; ++x)
+      if (!(row[x] < zMin))
+        return false;
+  }
+  return true;
+}
+
+size_t OcclusionBuffer::cull(const MiniGLM::mat4 &mvp,
+                             const EdgeClusters &clusters,
+                             std::vector<uint32_t> &visible) const {
+  size_t culledEdges = 0;
+  size_t kept = 0;
+  for (uint32_t index : visible) {
+    const EdgeCluster &c = clusters.clusters()[index];
+    if (occluded(mvp, c.boundsMin, c.boundsMax))
+      culledEdges += c.edgeCount;
+    else
+      visible[kept++] = index;
+  }
+  visible.resize(kept);
+  return culledEdges;
+}
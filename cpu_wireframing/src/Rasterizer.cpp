@@ -1,7 +1,18 @@
 #include "Rasterizer.hpp"
+#include "CapsuleLine.hpp"
+#include "Gamma.hpp"
+#include "Parallel.hpp"
+#include "WuLine.hpp"
 #include <algorithm>
 #include <cmath>
 #include <fstream>
+#include <mutex>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 /**
  * @brief Constructs a Rasterizer object for a given image width and height.
@@ -14,7 +25,18 @@
  * @param height Height of the output image in pixels.
  */
 Rasterizer::Rasterizer(int width, int height)
-    : width_(width), height_(height), buffer_(width * height) {}
+    : width_(width), height_(height), buffer_(size_t(width) * height) {}
+
+/**
+ * @brief Changes the image size. The pixel vector only ever grows, so a
+ * window that is resized back and forth stops allocating once it has
+ * reached its largest size.
+ */
+void Rasterizer::resize(int width, int height) {
+  width_ = width;
+  height_ = height;
+  buffer_.resize(size_t(width) * height);
+}
 
 /**
  * @brief Clears the pixel buffer to a specified color.
@@ -43,11 +65,38 @@ void Rasterizer::setPixel(int x, int y, const Color &color) {
     buffer_[y * width_ + x] = color;
 }
 
-inline float frac(float x) { return x - std::floor(x); }
+// Moves dest toward color by a/255, leaving alpha untouched.
+static inline void blendToward(Color &dest, const Color &color, int a) {
+  dest.r = static_cast<uint8_t>(dest.r + ((color.r - dest.r) * a) / 255);
+  dest.g = static_cast<uint8_t>(dest.g + ((color.g - dest.g) * a) / 255);
+  dest.b = static_cast<uint8_t>(dest.b + ((color.b - dest.b) * a) / 255);
+}
+
+// Weight of coverage a (0..255) as a 0.16 fixed-point factor.
+static inline uint16_t coverageWeight(int a) {
+  return static_cast<uint16_t>(a * 257);
+}
+
+// Gamma-correct version of blendToward: lerps in 8.8 linear light.
+static inline void blendTowardLinear(Color &dest, const Color &color, int a) {
+  const Gamma::Tables &g = Gamma::tables();
+  const uint32_t w = coverageWeight(a), iw = 65535u - w;
+  auto mix = [&](uint8_t d, uint8_t s) {
+    uint32_t lin = (g.toLinear[d] * iw + g.toLinear[s] * w) >> 16;
+    return g.toSrgb[lin >> Gamma::kEncodeShift];
+  };
+  dest.r = mix(dest.r, color.r);
+  dest.g = mix(dest.g, color.g);
+  dest.b = mix(dest.b, color.b);
+}
 
 void Rasterizer::plotAA(int x, int y, const Color &color, float intensity) {
   if (x >= 0 && x < width_ && y >= 0 && y < height_ && intensity > 0.0f) {
     Color &dest = buffer_[y * width_ + x];
+    if (gamma_) {
+      blendTowardLinear(dest, color, static_cast<int>(intensity * 255.0f));
+      return;
+    }
     dest.r =
         static_cast<uint8_t>(color.r * intensity + dest.r * (1.0f - intensity));
     dest.g =
@@ -73,56 +122,342 @@ void Rasterizer::plotAA(int x, int y, const Color &color, float intensity) {
  */
 void Rasterizer::drawLine(const MiniGLM::ivec2 &p0, const MiniGLM::ivec2 &p1,
                           const Color &color) {
-  int x0 = p0.x, y0 = p0.y;
-  int x1 = p1.x, y1 = p1.y;
-  bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+  WuLine::trace(p0, p1, width_, height_,
+                [&](int x, int y, float intensity) {
+                  plotAA(x, y, color, intensity);
+                });
+}
 
-  if (steep) {
-    std::swap(x0, y0);
-    std::swap(x1, y1);
+/**
+ * @brief Draws an anti-aliased line, skipping pixels that lie behind the
+ * surfaces in the given depth buffer.
+ *
+ * @param z0 Screen-space depth of p0.
+ * @param z1 Screen-space depth of p1.
+ * @param depth Depth buffer the mesh faces were rasterized into.
+ */
+void Rasterizer::drawLine(const MiniGLM::ivec2 &p0, const MiniGLM::ivec2 &p1,
+                          float z0, float z1, const Color &color,
+                          const DepthBuffer &depth) {
+  depth.traceVisible(p0, p1, z0, z1, [&](int x, int y, float intensity) {
+    plotAA(x, y, color, intensity);
+  });
+}
+
+/**
+ * @brief Narrows the step range [first, last] of a fixed-point DDA to the
+ * steps i at which start + step * i lies in [0, limit); empty ranges end
+ * with first > last. Exact, so the caller needs no per-pixel bounds test.
+ */
+static void clipSteps(int64_t start, int64_t step, int64_t limit, int &first,
+                      int &last) {
+  auto floorDiv = [](int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return a % b != 0 && (a < 0) != (b < 0) ? q - 1 : q;
+  };
+  auto ceilDiv = [&](int64_t a, int64_t b) { return -floorDiv(-a, b); };
+  if (step == 0) {
+    if (start < 0 || start >= limit)
+      last = first - 1;
+    return;
   }
-  if (x0 > x1) {
-    std::swap(x0, x1);
-    std::swap(y0, y1);
+  int64_t lo = step > 0 ? ceilDiv(-start, step)
+                        : ceilDiv(limit - 1 - start, step);
+  int64_t hi = step > 0 ? floorDiv(limit - 1 - start, step)
+                        : floorDiv(-start, step);
+  first = int(std::max<int64_t>(first, lo));
+  last = int(std::min<int64_t>(last, hi));
+}
+
+/**
+ * @brief Draws a one-pixel line without anti-aliasing.
+ *
+ * A DDA in 16.16 fixed point steps one pixel along the major axis and
+ * overwrites the pixel nearest to the line, which costs a fraction of a Wu
+ * line with its two blended samples per step. The steps are clipped to the
+ * viewport up front, so segments reaching far into the guard band cost
+ * nothing for their off-screen part.
+ *
+ * @param p0 The starting point of the line (as integer pixel coordinates).
+ * @param p1 The ending point of the line (as integer pixel coordinates).
+ * @param color The color written to every pixel.
+ * @param depth Optional depth buffer to test every pixel against.
+ * @param z0 Screen-space depth of p0 (only used with depth).
+ * @param z1 Screen-space depth of p1 (only used with depth).
+ * @param rowBegin First row that may be written.
+ * @param rowEnd One past the last row that may be written.
+ */
+void Rasterizer::drawLineAliased(const MiniGLM::ivec2 &p0,
+                                 const MiniGLM::ivec2 &p1, const Color &color,
+                                 const DepthBuffer *depth, float z0, float z1,
+                                 int rowBegin, int rowEnd) {
+  if (depth && depth->segmentOccluded(p0, p1, z0, z1))
+    return;
+  const int dx = p1.x - p0.x, dy = p1.y - p0.y;
+  const int steps = std::max(std::abs(dx), std::abs(dy));
+  // 16.16 fixed point; coordinates may be negative, so scale by multiplying.
+  constexpr int64_t kOne = 1 << 16;
+  const int64_t stepX = steps ? int64_t(dx) * kOne / steps : 0;
+  const int64_t stepY = steps ? int64_t(dy) * kOne / steps : 0;
+  const float stepZ = steps ? (z1 - z0) / float(steps) : 0.0f;
+  const int64_t x0 = int64_t(p0.x) * kOne + kOne / 2;
+  const int64_t y0 = int64_t(p0.y) * kOne + kOne / 2;
+  int first = 0, last = steps;
+  clipSteps(x0, stepX, int64_t(width_) * kOne, first, last);
+  rowBegin = std::max(rowBegin, 0);
+  rowEnd = std::min(rowEnd, height_);
+  if (rowBegin >= rowEnd)
+    return;
+  clipSteps(y0 - int64_t(rowBegin) * kOne, stepY,
+            int64_t(rowEnd - rowBegin) * kOne, first, last);
+  int64_t x = x0 + stepX * first, y = y0 + stepY * first;
+  for (int i = first; i <= last; ++i, x += stepX, y += stepY) {
+    const int px = int(x >> 16), py = int(y >> 16);
+    if (depth && !depth->visible(px, py, z0 + stepZ * float(i)))
+      continue;
+    buffer_[size_t(py) * width_ + px] = color;
   }
+}
 
-  float dx = float(x1 - x0);
-  float dy = float(y1 - y0);
-  float gradient = dx == 0.0f ? 1.0f : dy / dx;
-
-  int xEnd = x0;
-  float yEnd = y0 + gradient * (xEnd - x0);
-  int xPixel1 = xEnd;
-  int yPixel1 = int(yEnd);
-
-  if (steep) {
-    plotAA(yPixel1, xPixel1, color, 1 - frac(yEnd));
-    plotAA(yPixel1 + 1, xPixel1, color, frac(yEnd));
-  } else {
-    plotAA(xPixel1, yPixel1, color, 1 - frac(yEnd));
-    plotAA(xPixel1, yPixel1 + 1, color, frac(yEnd));
+/**
+ * @brief Draws a line of arbitrary width as an anti-aliased capsule.
+ *
+ * Coverage comes from the analytic distance to the segment, computed span by
+ * span by CapsuleLine::trace, so wide print-resolution lines need a single
+ * pass instead of supersampling.
+ *
+ * @param p0 Start point in (sub)pixel coordinates.
+ * @param p1 End point in (sub)pixel coordinates.
+ * @param width Line width in pixels.
+ * @param color The color to use when drawing the line.
+ * @param depth Optional depth buffer to test every pixel against.
+ * @param z0 Screen-space depth of p0 (only used with depth).
+ * @param z1 Screen-space depth of p1 (only used with depth).
+ */
+void Rasterizer::drawThickLine(const MiniGLM::vec2 &p0,
+                               const MiniGLM::vec2 &p1, float width,
+                               const Color &color, const DepthBuffer *depth,
+                               float z0, float z1) {
+  CapsuleLine::trace(p0, p1, width, width_, height_,
+                     [&](int y, int x, int count, const float *cov,
+                         const float *t) {
+                       uint8_t alpha[CapsuleLine::kChunk];
+                       for (int i = 0; i < count; ++i) {
+                         alpha[i] = static_cast<uint8_t>(cov[i] * 255.0f);
+                         if (depth &&
+                             !depth->visible(x + i, y, z0 + (z1 - z0) * t[i]))
+                           alpha[i] = 0;
+                       }
+                       blendSpan(buffer_.data() + y * width_ + x, alpha, count,
+                                 color);
+                     });
+}
+
+/**
+ * @brief Blends a run of pixels toward one color by per-pixel coverage.
+ *
+ * In gamma-correct mode the sRGB -> linear decode and linear -> sRGB encode
+ * are table lookups, and the lerp itself runs on two pixels (eight 16-bit
+ * channels) per SSE2 instruction as dest * (1 - w) + color * w, using the
+ * high half of 16x16 bit products so no intermediate exceeds 16 bits.
+ * Alpha is left untouched in both modes.
+ *
+ * @param dest First pixel of the run.
+ * @param alpha Coverage per pixel, 0..255.
+ * @param n Number of pixels.
+ * @param color The color blended toward.
+ */
+void Rasterizer::blendSpan(Color *dest, const uint8_t *alpha, int n,
+                           const Color &color) const {
+  if (!gamma_) {
+    for (int x = 0; x < n; ++x)
+      if (alpha[x])
+        blendToward(dest[x], color, alpha[x]);
+    return;
   }
-  float y = yEnd + gradient;
-
-  for (int x = xPixel1 + 1; x < x1; ++x) {
-    int yPix = int(y);
-    if (steep) {
-      plotAA(yPix, x, color, 1 - frac(y));
-      plotAA(yPix + 1, x, color, frac(y));
-    } else {
-      plotAA(x, yPix, color, 1 - frac(y));
-      plotAA(x, yPix + 1, color, frac(y));
-    }
-    y += gradient;
+
+  int x = 0;
+#if defined(__SSE2__)
+  const Gamma::Tables &g = Gamma::tables();
+  const uint16_t sr = g.toLinear[color.r], sg = g.toLinear[color.g],
+                 sb = g.toLinear[color.b];
+  const __m128i src = _mm_setr_epi16(sr, sg, sb, 0, sr, sg, sb, 0);
+  for (; x + 2 <= n; x += 2) {
+    if ((alpha[x] | alpha[x + 1]) == 0)
+      continue;
+    Color &d0 = dest[x], &d1 = dest[x + 1];
+    const uint16_t w0 = coverageWeight(alpha[x]);
+    const uint16_t w1 = coverageWeight(alpha[x + 1]);
+    __m128i lin = _mm_setr_epi16(g.toLinear[d0.r], g.toLinear[d0.g],
+                                 g.toLinear[d0.b], 0, g.toLinear[d1.r],
+                                 g.toLinear[d1.g], g.toLinear[d1.b], 0);
+    __m128i w = _mm_setr_epi16(w0, w0, w0, w0, w1, w1, w1, w1);
+    __m128i iw = _mm_sub_epi16(_mm_set1_epi16(-1), w);
+    __m128i out =
+        _mm_add_epi16(_mm_mulhi_epu16(lin, iw), _mm_mulhi_epu16(src, w));
+    out = _mm_srli_epi16(out, Gamma::kEncodeShift);
+    alignas(16) uint16_t idx[8];
+    _mm_store_si128(reinterpret_cast<__m128i *>(idx), out);
+    d0.r = g.toSrgb[idx[0]];
+    d0.g = g.toSrgb[idx[1]];
+    d0.b = g.toSrgb[idx[2]];
+    d1.r = g.toSrgb[idx[4]];
+    d1.g = g.toSrgb[idx[5]];
+    d1.b = g.toSrgb[idx[6]];
+  }
+#endif
+  for (; x < n; ++x)
+    if (alpha[x])
+      blendTowardLinear(dest[x], color, alpha[x]);
+}
+
+/**
+ * @brief Folds one coverage row into an accumulator row, 16 pixels per
+ * instruction where SIMD is available.
+ */
+static void reduceCoverageRow(uint8_t *acc, const uint8_t *src, int n,
+                              CoverageMerge merge) {
+  int x = 0;
+#if defined(__SSE2__)
+  for (; x + 16 <= n; x += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + x));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x));
+    a = merge == CoverageMerge::Max ? _mm_max_epu8(a, b) : _mm_adds_epu8(a, b);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(acc + x), a);
+  }
+#elif defined(__ARM_NEON)
+  for (; x + 16 <= n; x += 16) {
+    uint8x16_t a = vld1q_u8(acc + x);
+    uint8x16_t b = vld1q_u8(src + x);
+    vst1q_u8(acc + x,
+             merge == CoverageMerge::Max ? vmaxq_u8(a, b) : vqaddq_u8(a, b));
+  }
+#endif
+  for (; x < n; ++x) {
+    if (merge == CoverageMerge::Max)
+      acc[x] = std::max(acc[x], src[x]);
+    else
+      acc[x] = static_cast<uint8_t>(std::min(255, acc[x] + src[x]));
   }
+}
+
+/**
+ * @brief Merges per-thread coverage buffers and composites the result over
+ * the pixel buffer in a single color.
+ *
+ * Rows are split across threads, so every thread owns a disjoint band of
+ * buffer_ and no synchronisation is needed. The cost depends on the
+ * resolution and the number of layers only, never on how many edges were
+ * drawn into them.
+ *
+ * @param layers Coverage buffers, one per worker, sized like this rasterizer.
+ * @param color Line color applied to the merged coverage.
+ * @param merge Reduction used across layers (max or saturating add).
+ */
+void Rasterizer::resolveCoverage(const std::vector<CoverageBuffer> &layers,
+                                 const Color &color, CoverageMerge merge) {
+  auto worker = [&](size_t yBegin, size_t yEnd, size_t) {
+    std::vector<uint8_t> acc(width_);
+    for (int y = int(yBegin); y < int(yEnd); ++y) {
+      bool any = false;
+      for (const CoverageBuffer &layer : layers) {
+        if (y < layer.dirtyMinY() || y > layer.dirtyMaxY())
+          continue;
+        if (!any)
+          std::copy(layer.row(y), layer.row(y) + width_, acc.begin());
+        else
+          reduceCoverageRow(acc.data(), layer.row(y), width_, merge);
+        any = true;
+      }
+      if (!any)
+        continue;
 
-  int xPixel2 = x1;
-  float yPixel2 = y1;
-  if (steep) {
-    plotAA(int(yPixel2), xPixel2, color, 1 - frac(yPixel2));
-    plotAA(int(yPixel2) + 1, xPixel2, color, frac(yPixel2));
-  } else {
-    plotAA(xPixel2, int(yPixel2), color, 1 - frac(yPixel2));
-    plotAA(xPixel2, int(yPixel2) + 1, color, frac(yPixel2));
+      blendSpan(buffer_.data() + y * width_, acc.data(), width_, color);
+    }
+  };
+
+  Parallel::forEachChunk(height_, Parallel::threadCount(), worker);
+}
+
+/**
+ * @brief Widens one 16-bit density row and adds it to a 32-bit total row.
+ */
+static void accumulateDensityRow(uint32_t *total, const uint16_t *src, int n) {
+  int x = 0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  for (; x + 8 <= n; x += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x));
+    __m128i *t = reinterpret_cast<__m128i *>(total + x);
+    __m128i lo = _mm_add_epi32(_mm_loadu_si128(t), _mm_unpacklo_epi16(v, zero));
+    __m128i hi =
+        _mm_add_epi32(_mm_loadu_si128(t + 1), _mm_unpackhi_epi16(v, zero));
+    _mm_storeu_si128(t, lo);
+    _mm_storeu_si128(t + 1, hi);
+  }
+#elif defined(__ARM_NEON)
+  for (; x + 8 <= n; x += 8) {
+    uint16x8_t v = vld1q_u16(src + x);
+    vst1q_u32(total + x, vaddw_u16(vld1q_u32(total + x), vget_low_u16(v)));
+    vst1q_u32(total + x + 4,
+              vaddw_u16(vld1q_u32(total + x + 4), vget_high_u16(v)));
   }
+#endif
+  for (; x < n; ++x)
+    total[x] += src[x];
+}
+
+/**
+ * @brief Sums per-thread density buffers and tone-maps the result onto the
+ * pixel buffer.
+ *
+ * The first pass adds all layers into a 32-bit total per pixel and finds the
+ * peak density; the second maps each total logarithmically against that peak
+ * and blends the line color over the background by the mapped value. Both
+ * passes split rows across threads.
+ *
+ * @param layers Density buffers, one per worker, sized like this rasterizer.
+ * @param color Color used for the densest pixels.
+ */
+void Rasterizer::resolveDensity(const std::vector<DensityBuffer> &layers,
+                                const Color &color) {
+  densityTotal_.assign(buffer_.size(), 0);
+  std::mutex peakMutex;
+  uint32_t peak = 0;
+
+  const size_t bands = Parallel::threadCount();
+  Parallel::forEachChunk(height_, bands, [&](size_t yBegin, size_t yEnd,
+                                             size_t) {
+    uint32_t bandPeak = 0;
+    for (int y = int(yBegin); y < int(yEnd); ++y) {
+      uint32_t *total = densityTotal_.data() + y * width_;
+      for (const DensityBuffer &layer : layers)
+        if (y >= layer.dirtyMinY() && y <= layer.dirtyMaxY())
+          accumulateDensityRow(total, layer.row(y), width_);
+      for (int x = 0; x < width_; ++x)
+        bandPeak = std::max(bandPeak, total[x]);
+    }
+    std::lock_guard<std::mutex> lock(peakMutex);
+    peak = std::max(peak, bandPeak);
+  });
+
+  if (peak == 0)
+    return;
+  const float invLogPeak = 1.0f / std::log1p(float(peak));
+
+  Parallel::forEachChunk(height_, bands, [&](size_t yBegin, size_t yEnd,
+                                             size_t) {
+    std::vector<uint8_t> alpha(width_);
+    for (int y = int(yBegin); y < int(yEnd); ++y) {
+      const uint32_t *total = densityTotal_.data() + y * width_;
+      for (int x = 0; x < width_; ++x) {
+        alpha[x] = total[x] == 0
+                       ? 0
+                       : static_cast<uint8_t>(std::log1p(float(total[x])) *
+                                                  invLogPeak * 255.0f +
+                                              0.5f);
+      }
+      blendSpan(buffer_.data() + y * width_, alpha.data(), width_, color);
+    }
+  });
 }
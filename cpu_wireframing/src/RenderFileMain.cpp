@@ -1,37 +1,39 @@
+#include "ClipStage.hpp"
+#include "EdgeBvh.hpp"
+#include "EdgeFilter.hpp"
+#include "EdgeLod.hpp"
 #include "MiniGLM.hpp"
 #include "ObjParser.hpp"
+#include "OcclusionBuffer.hpp"
+#include "Parallel.hpp"
 #include "Rasterizer.hpp"
+#include "RenderOptions.hpp"
+#include "SegmentDedup.hpp"
+#include "TaskGraph.hpp"
 #include "VertexProcessor.hpp"
 #include <QImage>
 #include <QString>
 #include <algorithm>
 #include <cmath>
+#include <cstdio>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
-constexpr int WINDOW_WIDTH = 1000;
-constexpr int WINDOW_HEIGHT = 1000;
-
-MiniGLM::ivec2 ndcToScreen(const MiniGLM::vec4 &ndc, int width, int height) {
-  int x = static_cast<int>((ndc.x * 0.5f + 0.5f) * width);
-  int y = static_cast<int>((1.0f - (ndc.y * 0.5f + 0.5f)) * height);
-  return {x, y};
-}
-
-bool clipScreenLine(MiniGLM::ivec2 &p0, MiniGLM::ivec2 &p1, int width,
-                    int height) {
-  if ((p0.x < 0 && p1.x < 0) || (p0.x >= width && p1.x >= width))
-    return false;
-  if ((p0.y < 0 && p1.y < 0) || (p0.y >= height && p1.y >= height))
-    return false;
-  return true;
-}
+// Clip and raster chunks per pool thread; small enough to balance by
+// stealing.
+static constexpr size_t kChunksPerWorker = 8;
+// Pixels per chunk of the RGBA conversion.
+static constexpr size_t kPixelGrain = 1 << 16;
 
 int main(int argc, char **argv) {
-  if (argc != 7) {
+  RenderOptions options;
+  if (argc < 7 || !parseRenderOptions(argc, argv, 7, options,
+                                         RenderProgram::File)) {
     std::cerr << "Usage: render-to-file input.obj cam_x cam_y cam_z "
-                 "[perspective|orthographic] output.png\n";
+                 "[perspective|orthographic] output.png [options]\n"
+              << renderOptionsUsage(RenderProgram::File);
     return 1;
   }
 
@@ -41,6 +43,10 @@ int main(int argc, char **argv) {
   float camZ = std::stof(argv[4]);
   std::string projType = argv[5];
   const char *outFile = argv[6];
+  const int width = options.width;
+  const int height = options.height;
+
+  ThreadPool::setSharedOptions(options.pool);
 
   ObjParser parser;
   if (!parser.load(objFile)) {
@@ -59,8 +65,7 @@ int main(int argc, char **argv) {
   MiniGLM::mat4 proj;
   if (projType == "perspective") {
     proj = MiniGLM::perspective(MiniGLM::radians(100.0f),
-                                float(WINDOW_WIDTH) / WINDOW_HEIGHT, 0.01f,
-                                100.0f);
+                                float(width) / height, 0.01f, 100.0f);
   } else if (projType == "orthographic") {
     proj = MiniGLM::ortho(-6.0f, 6.0f, -4.0f, 4.0f, 0.01f, 100.0f);
   } else {
@@ -69,71 +74,299 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  VertexProcessor processor(model, view, proj);
-  Rasterizer raster(WINDOW_WIDTH, WINDOW_HEIGHT);
+  // --orbit turns the eye around the Y axis through the origin, one step
+  // per frame.
+  const size_t frameCount = size_t(options.orbitFrames);
+  auto frameEye = [&](size_t frame) {
+    float angle = 2.0f * float(M_PI) * float(frame) / float(frameCount);
+    float c = std::cos(angle), s = std::sin(angle);
+    return MiniGLM::vec3(c * eye.x + s * eye.z, eye.y, c * eye.z - s * eye.x);
+  };
+  auto frameFile = [&](size_t frame) {
+    std::string file = outFile;
+    if (frameCount == 1)
+      return file;
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), "_%04zu", frame);
+    size_t dot = file.find_last_of('.');
+    size_t slash = file.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+      dot = file.size();
+    return file.insert(dot, suffix);
+  };
 
-  raster.clear(Color(24, 24, 28));
+  VertexProcessor processor(model, view, proj);
+  Rasterizer raster(width, height);
+  raster.setGammaCorrect(options.gammaCorrect);
 
-  auto clip_space = processor.transformVertices(parser.vertices);
+  const size_t threads = Parallel::threadCount();
+  std::vector<CoverageBuffer> coverage;
+  std::vector<DensityBuffer> density;
+  for (size_t t = 0; t < threads; ++t) {
+    if (options.rasterMode == RasterMode::PrivateCoverage)
+      coverage.emplace_back(width, height, options.coverageMerge);
+    else if (options.rasterMode == RasterMode::Density)
+      density.emplace_back(width, height);
+  }
+  std::vector<uint8_t> rgba(size_t(width) * height * 4);
 
   Color white(255, 255, 255);
   constexpr float near_epsilon = 1e-3f;
-  constexpr float ndc_limit = 100.0f;
+  const bool thick = options.lineWidth > 1.0f;
 
-  auto excess = [](float v) { return std::max(0.0f, std::fabs(v) - 1.0f); };
-  float threshold = ndc_limit - 1.0f;
+  // What the raster stage needs of one frame. Two of them let the next
+  // frame's geometry be built while this one is drawn.
+  struct FrameGeometry {
+    MiniGLM::mat4 mvp;
+    std::unique_ptr<DepthBuffer> depth;
+    std::vector<ScreenSegment> segments;
+    ClipStats stats;
+  };
+  FrameGeometry frames[2];
 
-  for (const auto &edge : parser.edges) {
-    MiniGLM::vec4 clipV0 = clip_space[edge.first];
-    MiniGLM::vec4 clipV1 = clip_space[edge.second];
+  EdgeBvh bvh;
+  std::vector<int> triangles;
+  std::unique_ptr<OcclusionBuffer> occlusion;
+  std::unique_ptr<EdgeFilter> filter;
+  EdgeLod lod;
+  // The camera-dependent buffers of a frame: face depth, occluder depth and
+  // the facing of every edge.
+  auto renderDepth = [&](FrameGeometry &frame) {
+    auto clip_space = processor.transformVertices(parser.vertices);
+    if (!frame.depth)
+      frame.depth =
+          std::make_unique<DepthBuffer>(width, height, options.depthBias);
+    else
+      frame.depth->clear();
+    frame.depth->rasterize(clip_space, triangles, near_epsilon);
+  };
+  auto prepareCamera = [&](FrameGeometry &frame, size_t index) {
+    processor.setViewMatrix(
+        MiniGLM::lookAt(frameEye(index), center, MiniGLM::vec3(0, 1, 0)));
+    frame.mvp = processor.modelViewProjection();
+    if (options.hiddenLine)
+      renderDepth(frame);
+    if (occlusion)
+      occlusion->render(frame.mvp);
+    if (filter)
+      filter->update(processor.eyePosition());
+  };
 
-    if (clipV0.w < near_epsilon || clipV1.w < near_epsilon)
-      continue;
+  // Everything that only needs the mesh and the first camera is one task
+  // graph: the hierarchy and the face-based stages overlap, and the stages
+  // built on the clusters start as soon as the hierarchy is there.
+  frames[0].mvp = processor.modelViewProjection();
+  TaskGraph setup;
+  const TaskGraph::Task built = setup.add([&] {
+    bvh = EdgeBvh::loadOrBuild(parser.vertices, parser.edges,
+                               options.bvhCache);
+  });
+  const TaskGraph::Task triangulated = setup.add([&] {
+    if (options.hiddenLine ||
+        (options.occlusionCulling && options.occluderFile.empty()))
+      triangles = parser.triangulateFaces();
+  });
+  if (options.hiddenLine)
+    setup.add([&] { renderDepth(frames[0]); }, {triangulated});
+  if (options.occlusionCulling) {
+    setup.add(
+        [&] {
+          occlusion = options.occluderFile.empty()
+                          ? OcclusionBuffer::largestFaces(parser.vertices,
+                                                          triangles)
+                          : OcclusionBuffer::load(options.occluderFile);
+          if (occlusion)
+            occlusion->render(frames[0].mvp);
+        },
+        {triangulated});
+  }
+  if (options.cullBackfaces || options.outlineOnly) {
+    setup.add(
+        [&] {
+          filter = std::make_unique<EdgeFilter>(
+              parser.facePlanes, parser.edgeFaces, bvh.clusters());
+          filter->setCullBackfaces(options.cullBackfaces);
+          filter->setOutlineOnly(options.outlineOnly, options.creaseAngle);
+          filter->update(processor.eyePosition());
+        },
+        {built});
+  }
+  if (options.lod)
+    setup.add([&] { lod = EdgeLod(bvh.clusters()); }, {built});
+  setup.run();
+  if (options.occlusionCulling && !occlusion)
+    return 1;
 
-    float ndc_x0 = clipV0.x / clipV0.w;
-    float ndc_y0 = clipV0.y / clipV0.w;
-    float ndc_x1 = clipV1.x / clipV1.w;
-    float ndc_y1 = clipV1.y / clipV1.w;
+  const EdgeClusters &clusters = bvh.clusters();
+  if (options.pick) {
+    long edge = bvh.pickEdge(frames[0].mvp, width, height, options.pickX,
+                             options.pickY);
+    if (edge >= 0)
+      std::cout << "Picked edge " << edge << " (" << parser.edges[edge].first
+                << " - " << parser.edges[edge].second << ")\n";
+    else
+      std::cout << "No edge at " << options.pickX << "," << options.pickY
+                << "\n";
+  }
+  std::vector<uint32_t> visible;
+  std::vector<MiniGLM::vec4> clip_space(clusters.vertices().size());
+  std::vector<MiniGLM::vec4> lod_clip_space(lod.vertices().size());
 
-    float ndc_x0_excess = excess(ndc_x0);
-    float ndc_y0_excess = excess(ndc_y0);
-    float ndc_x1_excess = excess(ndc_x1);
-    float ndc_y1_excess = excess(ndc_y1);
+  ClipStage clipStage(width, height);
+  clipStage.setGuardBand(options.guardBand);
 
-    bool p0_far = std::max(ndc_x0_excess, ndc_y0_excess) > threshold;
-    bool p1_far = std::max(ndc_x1_excess, ndc_y1_excess) > threshold;
+  // Only clusters that intersect the frustum are transformed and clipped.
+  // Chunks of clusters are clipped in parallel into their own lists, which
+  // are joined in cluster order, so the segment stream (and the image) is
+  // the same for any thread count.
+  auto clipFrame = [&](FrameGeometry &frame) {
+    const MiniGLM::mat4 &mvp = frame.mvp;
+    frame.stats = ClipStats();
+    frame.stats.culled = bvh.cullFrustum(mvp, visible);
+    if (occlusion)
+      frame.stats.occluded = occlusion->cull(mvp, clusters, visible);
+    const size_t grain =
+        std::max<size_t>(1, visible.size() / (threads * kChunksPerWorker));
+    const size_t chunkCount = (visible.size() + grain - 1) / grain;
+    std::vector<std::vector<ScreenSegment>> chunkSegments(chunkCount);
+    std::vector<ClipStats> chunkStats(chunkCount);
+    Parallel::parallelFor(visible.size(), grain, [&](size_t begin, size_t end,
+                                                     size_t) {
+      std::vector<ScreenSegment> &out = chunkSegments[begin / grain];
+      ClipStats &chunk = chunkStats[begin / grain];
+      for (size_t k = begin; k < end; ++k) {
+        const EdgeCluster &c = clusters.clusters()[visible[k]];
+        // Coarser levels have their own edges; the options never combine
+        // them with a filter.
+        int level = lod.selectLevel(mvp, width, height, c);
+        if (level > 0) {
+          const LodLevel &l = lod.level(visible[k], level);
+          processor.transformRange(lod.vertices(), l.firstVertex,
+                                   l.firstVertex + l.vertexCount,
+                                   lod_clip_space);
+          clipStage.run(lod_clip_space, lod.edges(), l.firstEdge,
+                        l.firstEdge + l.edgeCount, out, chunk);
+          chunk.simplified += c.edgeCount - l.edgeCount;
+          continue;
+        }
+        processor.transformRange(clusters.vertices(), c.firstVertex,
+                                 c.firstVertex + c.vertexCount, clip_space);
+        clipStage.run(clip_space, clusters.edges(), c.firstEdge,
+                      c.firstEdge + c.edgeCount, out, chunk, filter.get());
+      }
+    });
+    frame.segments.clear();
+    for (size_t k = 0; k < chunkCount; ++k) {
+      frame.segments.insert(frame.segments.end(), chunkSegments[k].begin(),
+                            chunkSegments[k].end());
+      frame.stats += chunkStats[k];
+    }
+    if (options.dedup)
+      SegmentDedup().run(frame.segments, frame.stats);
+  };
 
-    if (p0_far || p1_far)
-      continue;
+  auto drawFrame = [&](const FrameGeometry &frame, size_t index) {
+    const DepthBuffer *depth = frame.depth.get();
+    auto drawSegment = [&](const ScreenSegment &seg, size_t slot) {
+      const MiniGLM::vec2 &f0 = seg.p0, &f1 = seg.p1;
+      const float z0 = seg.z0, z1 = seg.z1;
 
-    MiniGLM::ivec2 p0 =
-        ndcToScreen({ndc_x0, ndc_y0, 0, 0}, WINDOW_WIDTH, WINDOW_HEIGHT);
-    MiniGLM::ivec2 p1 =
-        ndcToScreen({ndc_x1, ndc_y1, 0, 0}, WINDOW_WIDTH, WINDOW_HEIGHT);
+      if (thick) {
+        float w = options.lineWidth;
+        if (options.rasterMode == RasterMode::PrivateCoverage)
+          coverage[slot].drawThickLine(f0, f1, w, depth, z0, z1);
+        else if (options.rasterMode == RasterMode::Density)
+          density[slot].drawThickLine(f0, f1, w, depth, z0, z1);
+        else
+          raster.drawThickLine(f0, f1, w, white, depth, z0, z1);
+        return;
+      }
 
-    int dx = p0.x - p1.x, dy = p0.y - p1.y;
-    if ((dx * dx + dy * dy) < 4)
-      continue;
+      MiniGLM::ivec2 p0 = toPixel(f0), p1 = toPixel(f1);
+      if (depth) {
+        if (options.rasterMode == RasterMode::PrivateCoverage)
+          coverage[slot].drawLine(p0, p1, z0, z1, *depth);
+        else if (options.rasterMode == RasterMode::Density)
+          density[slot].drawLine(p0, p1, z0, z1, *depth);
+        else
+          raster.drawLine(p0, p1, z0, z1, white, *depth);
+      } else if (options.rasterMode == RasterMode::PrivateCoverage)
+        coverage[slot].drawLine(p0, p1);
+      else if (options.rasterMode == RasterMode::Density)
+        density[slot].drawLine(p0, p1);
+      else
+        raster.drawLine(p0, p1, white);
+    };
+    if (options.printStats)
+      std::cout << frame.stats << "\n";
+    raster.clear(Color(24, 24, 28));
+    if (index > 0) {
+      for (CoverageBuffer &layer : coverage)
+        layer.clear();
+      for (DensityBuffer &layer : density)
+        layer.clear();
+    }
+    // Per-worker buffers merge the same for any split of the segments; the
+    // shared buffer blends in order and is drawn by one thread.
+    const std::vector<ScreenSegment> &segments = frame.segments;
+    if (options.rasterMode == RasterMode::Shared) {
+      for (const ScreenSegment &seg : segments)
+        drawSegment(seg, 0);
+    } else {
+      Parallel::parallelFor(
+          segments.size(),
+          std::max<size_t>(1, segments.size() / (threads * kChunksPerWorker)),
+          [&](size_t begin, size_t end, size_t worker) {
+            for (size_t i = begin; i < end; ++i)
+              drawSegment(segments[i], worker);
+          });
+    }
+    if (options.rasterMode == RasterMode::PrivateCoverage)
+      raster.resolveCoverage(coverage, white, options.coverageMerge);
+    else if (options.rasterMode == RasterMode::Density)
+      raster.resolveDensity(density, white);
 
-    if (clipScreenLine(p0, p1, WINDOW_WIDTH, WINDOW_HEIGHT))
-      raster.drawLine(p0, p1, white);
-  }
+    const auto &buf = raster.getBuffer();
+    Parallel::parallelFor(buf.size(), kPixelGrain,
+                          [&](size_t begin, size_t end, size_t) {
+                            for (size_t i = begin; i < end; ++i) {
+                              rgba[i * 4 + 0] = buf[i].r;
+                              rgba[i * 4 + 1] = buf[i].g;
+                              rgba[i * 4 + 2] = buf[i].b;
+                              rgba[i * 4 + 3] = 255;
+                            }
+                          });
 
-  const auto &buf = raster.getBuffer();
-  std::vector<uint8_t> rgba(WINDOW_WIDTH * WINDOW_HEIGHT * 4);
-  for (size_t i = 0; i < buf.size(); ++i) {
-    rgba[i * 4 + 0] = buf[i].r;
-    rgba[i * 4 + 1] = buf[i].g;
-    rgba[i * 4 + 2] = buf[i].b;
-    rgba[i * 4 + 3] = 255;
-  }
+    const std::string file = frameFile(index);
+    QImage image(rgba.data(), width, height, QImage::Format_RGBA8888);
+    if (!image.save(QString::fromUtf8(file.c_str()), "PNG")) {
+      std::cerr << "Could not write output PNG file.\n";
+      return false;
+    }
+    std::cout << "Rendered frame saved to " << file << "\n";
+    return true;
+  };
 
-  QImage image(rgba.data(), WINDOW_WIDTH, WINDOW_HEIGHT,
-               QImage::Format_RGBA8888);
-  if (!image.save(QString::fromUtf8(outFile), "PNG")) {
-    std::cerr << "Could not write output PNG file.\n";
-    return 1;
+  // Frame k is drawn, resolved and saved while the camera buffers and
+  // segments of frame k + 1 are built in the other slot; the pool's
+  // workers steal from whichever stage has chunks left.
+  clipFrame(frames[0]);
+  for (size_t k = 0; k < frameCount; ++k) {
+    FrameGeometry &current = frames[k % 2];
+    FrameGeometry &next = frames[(k + 1) % 2];
+    bool saved = true;
+    TaskGraph step;
+    step.add([&] { saved = drawFrame(current, k); });
+    if (k + 1 < frameCount)
+      step.add([&] {
+        prepareCamera(next, k + 1);
+        clipFrame(next);
+      });
+    step.run();
+    if (!saved)
+      return 1;
   }
-  std::cout << "Rendered frame saved to " << outFile << "\n";
+  if (options.printStats)
+    std::cout << ThreadPool::shared() << "\n";
   return 0;
 }
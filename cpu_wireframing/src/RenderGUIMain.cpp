@@ -1,14 +1,21 @@
 #include "ObjParser.hpp"
+#include "RenderOptions.hpp"
+#include "ThreadPool.hpp"
 #include "WireframeApp.hpp"
 #include <QApplication>
 #include <iostream>
 
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    std::cerr << "Usage: ./framer <.obj file>\n";
+  RenderOptions options;
+  if (argc < 2 ||
+      !parseRenderOptions(argc, argv, 2, options, RenderProgram::Gui)) {
+    std::cerr << "Usage: ./framer <.obj file> [options]\n"
+              << renderOptionsUsage(RenderProgram::Gui);
     return 1;
   }
 
+  ThreadPool::setSharedOptions(options.pool);
+
   ObjParser parser;
   if (!parser.load(argv[1])) {
     std::cerr << "Failed to load OBJ file.\n";
@@ -20,12 +27,20 @@ int main(int argc, char **argv) {
 
   QApplication app(argc, argv);
 
-  WireframeApp window(parser.vertices, parser.edges, 1200, 800);
+  WireframeApp window(parser.vertices, parser.edges,
+                      options.hiddenLine || options.occlusionCulling
+                          ? parser.triangulateFaces()
+                          : std::vector<int>(),
+                      parser.facePlanes, parser.edgeFaces, 1200, 800,
+                      options);
 
   window.setWindowTitle("Wireframe Renderer");
   window.resize(1200, 800);
 
   window.show();
 
-  return app.exec();
+  int status = app.exec();
+  if (options.printStats)
+    std::cout << ThreadPool::shared() << "\n";
+  return status;
 }
@@ -0,0 +1,294 @@
+#include "RenderOptions.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+// Environment variables read as if their flag came before the arguments.
+const char *const kEnvironment[][2] = {{"WIREFRAME_THREADS", "--threads"},
+                                       {"WIREFRAME_PIN", "--pin"},
+                                       {"WIREFRAME_NICE", "--nice"}};
+
+// Flags only one of the binaries acts on.
+const char *const kFileOnly[] = {"--size", "--pick", "--orbit"};
+const char *const kGuiOnly[] = {"--drag-scale"};
+
+bool appliesTo(const std::string &flag, RenderProgram program) {
+  if (program == RenderProgram::Gui)
+    return std::find(std::begin(kFileOnly), std::end(kFileOnly), flag) ==
+           std::end(kFileOnly);
+  return std::find(std::begin(kGuiOnly), std::end(kGuiOnly), flag) ==
+         std::end(kGuiOnly);
+}
+} // namespace
+
+/**
+ * @brief Parses the optional flags starting at argv[first], after the
+ * defaults given in the environment (see kEnvironment).
+ *
+ * @param argc Argument count as given to main.
+ * @param argv Argument vector as given to main.
+ * @param first Index of the first optional argument.
+ * @param options Receives the parsed settings.
+ * @param program The binary parsing them; flags only the other one
+ * understands are rejected rather than ignored.
+ * @return false if a flag is unknown or its value is missing/invalid.
+ */
+bool parseRenderOptions(int argc, char **argv, int first,
+                        RenderOptions &options, RenderProgram program) {
+  std::vector<std::string> args;
+  for (const auto &variable : kEnvironment) {
+    if (const char *v = std::getenv(variable[0])) {
+      args.push_back(variable[1]);
+      args.push_back(v);
+    }
+  }
+  args.insert(args.end(), argv + first, argv + std::max(first, argc));
+
+  for (size_t i = 0; i < args.size(); ++i) {
+    std::string flag = args[i];
+    if (!appliesTo(flag, program)) {
+      std::cerr << flag << " only applies to "
+                << (program == RenderProgram::Gui ? "render-to-file"
+                                                  : "render-gui")
+                << "\n";
+      return false;
+    }
+    auto value = [&](std::string &out) {
+      if (i + 1 >= args.size()) {
+        std::cerr << "Missing value for " << flag << "\n";
+        return false;
+      }
+      out = args[++i];
+      return true;
+    };
+
+    if (flag == "--private-buffers") {
+      options.rasterMode = RasterMode::PrivateCoverage;
+    } else if (flag == "--density") {
+      options.rasterMode = RasterMode::Density;
+    } else if (flag == "--hidden-line") {
+      options.hiddenLine = true;
+    } else if (flag == "--cull-backfaces") {
+      options.cullBackfaces = true;
+    } else if (flag == "--outline") {
+      options.outlineOnly = true;
+    } else if (flag == "--crease-angle") {
+      std::string v;
+      if (!value(v))
+        return false;
+      try {
+        options.creaseAngle = std::stof(v);
+      } catch (...) {
+        options.creaseAngle = -1.0f;
+      }
+      if (!(options.creaseAngle >= 0.0f && options.creaseAngle <= 180.0f)) {
+        std::cerr << "Crease angle must be between 0 and 180 degrees\n";
+        return false;
+      }
+    } else if (flag == "--depth-bias") {
+      std::string v;
+      if (!value(v))
+        return false;
+      try {
+        options.depthBias = std::stof(v);
+      } catch (...) {
+        std::cerr << "Invalid depth bias '" << v << "'\n";
+        return false;
+      }
+    } else if (flag == "--lod") {
+      options.lod = true;
+    } else if (flag == "--occlusion") {
+      options.occlusionCulling = true;
+    } else if (flag == "--occluders") {
+      if (!value(options.occluderFile))
+        return false;
+      options.occlusionCulling = true;
+    } else if (flag == "--dedup") {
+      options.dedup = true;
+    } else if (flag == "--gamma") {
+      options.gammaCorrect = true;
+    } else if (flag == "--stats") {
+      options.printStats = true;
+    } else if (flag == "--line-width") {
+      std::string v;
+      if (!value(v))
+        return false;
+      try {
+        options.lineWidth = std::stof(v);
+      } catch (...) {
+        options.lineWidth = 0.0f;
+      }
+      if (!(options.lineWidth >= 1.0f && options.lineWidth <= 64.0f)) {
+        std::cerr << "Line width must be between 1 and 64 pixels\n";
+        return false;
+      }
+    } else if (flag == "--guard-band") {
+      std::string v;
+      if (!value(v))
+        return false;
+      try {
+        options.guardBand = std::stof(v);
+      } catch (...) {
+        options.guardBand = 0.0f;
+      }
+      if (!(options.guardBand >= 1.0f && options.guardBand <= 16.0f)) {
+        std::cerr << "Guard band must be between 1 and 16 viewports\n";
+        return false;
+      }
+    } else if (flag == "--drag-scale") {
+      std::string v;
+      if (!value(v))
+        return false;
+      try {
+        options.interactiveScale = std::stof(v);
+      } catch (...) {
+        options.interactiveScale = 0.0f;
+      }
+      if (!(options.interactiveScale >= 0.1f &&
+            options.interactiveScale <= 1.0f)) {
+        std::cerr << "Drag scale must be between 0.1 and 1\n";
+        return false;
+      }
+    } else if (flag == "--threads") {
+      std::string v;
+      if (!value(v))
+        return false;
+      int threads = 0;
+      try {
+        threads = std::stoi(v);
+      } catch (...) {
+        threads = 0;
+      }
+      if (threads < 1 || threads > 1024) {
+        std::cerr << "Thread count must be between 1 and 1024\n";
+        return false;
+      }
+      options.pool.threads = size_t(threads);
+    } else if (flag == "--pin") {
+      std::string v;
+      if (!value(v))
+        return false;
+      if (v == "none")
+        options.pool.pinning = ThreadPinning::None;
+      else if (v == "cores")
+        options.pool.pinning = ThreadPinning::Cores;
+      else {
+        std::cerr << "Unknown pinning '" << v << "' (none|cores)\n";
+        return false;
+      }
+    } else if (flag == "--nice") {
+      std::string v;
+      if (!value(v))
+        return false;
+      int niceness = 100;
+      try {
+        niceness = std::stoi(v);
+      } catch (...) {
+        niceness = 100;
+      }
+      if (niceness < -20 || niceness > 19) {
+        std::cerr << "Niceness must be between -20 and 19\n";
+        return false;
+      }
+      options.pool.niceness = niceness;
+    } else if (flag == "--bvh-cache") {
+      if (!value(options.bvhCache))
+        return false;
+    } else if (flag == "--pick") {
+      std::string v;
+      if (!value(v))
+        return false;
+      if (std::sscanf(v.c_str(), "%f,%f", &options.pickX, &options.pickY) !=
+          2) {
+        std::cerr << "Invalid pick position '" << v << "' (expected X,Y)\n";
+        return false;
+      }
+      options.pick = true;
+    } else if (flag == "--size") {
+      std::string v;
+      if (!value(v))
+        return false;
+      if (std::sscanf(v.c_str(), "%dx%d", &options.width, &options.height) !=
+              2 ||
+          options.width <= 0 || options.height <= 0) {
+        std::cerr << "Invalid size '" << v << "' (expected WxH)\n";
+        return false;
+      }
+    } else if (flag == "--orbit") {
+      std::string v;
+      if (!value(v))
+        return false;
+      try {
+        options.orbitFrames = std::stoi(v);
+      } catch (...) {
+        options.orbitFrames = 0;
+      }
+      if (options.orbitFrames < 1 || options.orbitFrames > 100000) {
+        std::cerr << "Orbit frame count must be between 1 and 100000\n";
+        return false;
+      }
+    } else if (flag == "--merge") {
+      std::string v;
+      if (!value(v))
+        return false;
+      if (v == "max")
+        options.coverageMerge = CoverageMerge::Max;
+      else if (v == "add")
+        options.coverageMerge = CoverageMerge::SaturatingAdd;
+      else {
+        std::cerr << "Unknown merge mode '" << v << "' (max|add)\n";
+        return false;
+      }
+    } else {
+      std::cerr << "Unknown option " << flag << "\n";
+      return false;
+    }
+  }
+  // Simplified edges have no adjacent faces, so the filter could only
+  // thin out the clusters drawn at full detail.
+  if (options.lod && (options.cullBackfaces || options.outlineOnly)) {
+    std::cerr << "--lod cannot be combined with --cull-backfaces or "
+                 "--outline\n";
+    return false;
+  }
+  return true;
+}
+
+std::string renderOptionsUsage(RenderProgram program) {
+  std::string usage =
+      "Options:\n"
+      "  --private-buffers   draw into per-thread coverage buffers\n"
+      "  --merge max|add     coverage reduction for --private-buffers\n"
+      "  --density           accumulate line density and tone-map it\n"
+      "  --hidden-line       hide edges behind the mesh faces\n"
+      "  --depth-bias B      constant face depth offset for --hidden-line\n"
+      "  --cull-backfaces    skip edges between back-facing faces\n"
+      "  --outline           draw only silhouette and crease edges\n"
+      "  --crease-angle A    min dihedral angle of a crease (default 30)\n"
+      "  --line-width W      draw W pixel wide anti-aliased lines\n"
+      "  --lod               simplify clusters with sub-pixel detail\n"
+      "  --occlusion         skip clusters hidden behind the largest faces\n"
+      "  --occluders FILE    like --occlusion, with the faces of FILE\n"
+      "  --dedup             draw coinciding screen segments only once\n"
+      "  --gamma             blend anti-aliased pixels in linear light\n"
+      "  --guard-band G      only clip edges leaving G viewports (1-16)\n"
+      "  --stats             print clip statistics and thread pool load\n"
+      "  --threads N         threads to render with (default: all cores)\n"
+      "  --pin cores|none    pin threads, one per physical core first\n"
+      "  --nice N            niceness of the worker threads (-20..19)\n"
+      "  --bvh-cache FILE    load/save the edge BVH from/to FILE\n";
+  if (program == RenderProgram::Gui)
+    usage +=
+        "  --drag-scale F      resolution scale while dragging (default 0.5)\n";
+  else
+    usage += "  --size WxH          output image size (default 1000x1000)\n"
+             "  --orbit N           write N frames circling the model\n"
+             "  --pick X,Y          print the front-most edge at pixel X,Y\n";
+  return usage + "WIREFRAME_THREADS, WIREFRAME_PIN and WIREFRAME_NICE set "
+                 "defaults\nfor --threads, --pin and --nice.\n";
+}
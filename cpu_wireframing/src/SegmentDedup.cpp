@@ -0,0 +1,73 @@
+#include "SegmentDedup.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+int32_t snap(float v) {
+  return int32_t(std::floor(v * float(1 << SegmentDedup::kSubpixelBits) +
+                            0.5f));
+}
+
+uint64_t hashSegment(int32_t x0, int32_t y0, int32_t x1, int32_t y1) {
+  uint64_t a = (uint64_t(uint32_t(x0)) << 32) | uint32_t(y0);
+  uint64_t b = (uint64_t(uint32_t(x1)) << 32) | uint32_t(y1);
+  uint64_t h = a * 0x9E3779B97F4A7C15ull ^ (b + 0x632BE59BD9B4E019ull);
+  h ^= h >> 29;
+  h *= 0xBF58476D1CE4E5B9ull;
+  return h ^ (h >> 32);
+}
+
+} // namespace
+
+/**
+ * @brief Drops segments whose snapped, canonically ordered endpoints were
+ * already seen in this call. The table is sized to at least twice the
+ * segment count, so probes stay short.
+ */
+void SegmentDedup::run(std::vector<ScreenSegment> &segments,
+                       ClipStats &stats) {
+  size_t capacity = 64;
+  while (capacity < segments.size() * 2)
+    capacity *= 2;
+  if (table_.size() < capacity)
+    table_.resize(capacity);
+  capacity = table_.size();
+  for (Slot &slot : table_)
+    slot.index = kEmpty;
+  const size_t mask = capacity - 1;
+
+  size_t kept = 0;
+  for (size_t i = 0; i < segments.size(); ++i) {
+    ScreenSegment seg = segments[i];
+    int32_t x0 = snap(seg.p0.x), y0 = snap(seg.p0.y);
+    int32_t x1 = snap(seg.p1.x), y1 = snap(seg.p1.y);
+    if (x1 < x0 || (x1 == x0 && y1 < y0)) {
+      std::swap(x0, x1);
+      std::swap(y0, y1);
+      std::swap(seg.p0, seg.p1);
+      std::swap(seg.z0, seg.z1);
+    }
+
+    size_t h = size_t(hashSegment(x0, y0, x1, y1)) & mask;
+    while (true) {
+      Slot &slot = table_[h];
+      if (slot.index == kEmpty) {
+        slot = {x0, y0, x1, y1, uint32_t(kept)};
+        segments[kept++] = seg;
+        break;
+      }
+      if (slot.x0 == x0 && slot.y0 == y0 && slot.x1 == x1 && slot.y1 == y1) {
+        ScreenSegment &first = segments[slot.index];
+        first.z0 = std::min(first.z0, seg.z0);
+        first.z1 = std::min(first.z1, seg.z1);
+        break;
+      }
+      h = (h + 1) & mask;
+    }
+  }
+  size_t removed = segments.size() - kept;
+  segments.resize(kept);
+  stats.duplicates += removed;
+  stats.emitted -= removed;
+}
@@ -0,0 +1,53 @@
+#include "TaskGraph.hpp"
+#include <memory>
+
+/**
+ * @brief Adds a task.
+ *
+ * @param fn Work of the task.
+ * @param after Tasks that must finish before fn starts.
+ * @return Handle to pass in the `after` list of later tasks.
+ */
+TaskGraph::Task TaskGraph::add(std::function<void()> fn,
+                               const std::vector<Task> &after) {
+  const Task task = nodes_.size();
+  nodes_.push_back({std::move(fn), {}, after.size()});
+  for (Task dependency : after)
+    nodes_[dependency].dependents.push_back(task);
+  return task;
+}
+
+/**
+ * @brief Starts the tasks without dependencies; the rest are started from
+ * inside runReady as their counters reach zero.
+ */
+void TaskGraph::run(ThreadPool &pool) const {
+  auto pending = std::make_unique<std::atomic<size_t>[]>(nodes_.size());
+  std::vector<Task> ready;
+  for (Task task = 0; task < nodes_.size(); ++task) {
+    pending[task].store(nodes_[task].dependencies);
+    if (nodes_[task].dependencies == 0)
+      ready.push_back(task);
+  }
+  runReady(pool, ready, pending.get());
+}
+
+/**
+ * @brief Runs the given tasks in parallel. Whoever releases a dependent's
+ * last dependency forks the newly ready tasks before its chunk returns.
+ */
+void TaskGraph::runReady(ThreadPool &pool, const std::vector<Task> &ready,
+                         std::atomic<size_t> *pending) const {
+  pool.forkJoin(ready.size(), 1, [&](size_t begin, size_t end, size_t) {
+    for (size_t i = begin; i < end; ++i) {
+      const Node &node = nodes_[ready[i]];
+      node.fn();
+      std::vector<Task> next;
+      for (Task dependent : node.dependents)
+        if (pending[dependent].fetch_sub(1) == 1)
+          next.push_back(dependent);
+      if (!next.empty())
+        runReady(pool, next, pending);
+    }
+  });
+}
@@ -0,0 +1,363 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <utility>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Set on pool threads: their pool and participant index.
+thread_local const ThreadPool *currentPool = nullptr;
+thread_local size_t currentWorker = 0;
+// Chunks running on this thread, and the time the outermost one spent
+// waiting for nested forkJoin calls; that wait is not counted as busy.
+thread_local int runDepth = 0;
+thread_local uint64_t nestedWaitNanos = 0;
+
+std::mutex sharedMutex;
+ThreadPoolOptions sharedOptions;
+bool sharedStarted = false;
+
+#if defined(__linux__)
+int readTopology(int cpu, const char *field) {
+  char path[96];
+  std::snprintf(path, sizeof(path),
+                "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, field);
+  int value = -1;
+  if (FILE *file = std::fopen(path, "r")) {
+    if (std::fscanf(file, "%d", &value) != 1)
+      value = -1;
+    std::fclose(file);
+  }
+  return value;
+}
+#endif
+
+/**
+ * @brief The CPUs the process may run on, the first logical CPU of every
+ * physical core before any SMT sibling. Threads placed in this order only
+ * share a core's caches once every core has one. Empty where affinity is
+ * not supported.
+ */
+std::vector<int> cpusByCore() {
+  std::vector<int> order;
+#if defined(__linux__)
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    return order;
+  std::set<std::pair<int, int>> cores;
+  std::vector<int> siblings;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (!CPU_ISSET(cpu, &allowed))
+      continue;
+    std::pair<int, int> core(readTopology(cpu, "physical_package_id"),
+                             readTopology(cpu, "core_id"));
+    // Without topology information every CPU counts as its own core.
+    if (core.second < 0 || cores.insert(core).second)
+      order.push_back(cpu);
+    else
+      siblings.push_back(cpu);
+  }
+  order.insert(order.end(), siblings.begin(), siblings.end());
+#endif
+  return order;
+}
+} // namespace
+
+/**
+ * @brief Starts threads - 1 workers; threads outside the pool calling
+ * forkJoin are the remaining participant.
+ */
+ThreadPool::ThreadPool(size_t threads)
+    : ThreadPool(ThreadPoolOptions{std::max<size_t>(1, threads)}) {}
+
+/**
+ * @brief Starts options.threads - 1 workers (one per CPU for 0), pinned and
+ * reniced as requested. Every worker places itself when it starts; a
+ * placement the system refuses is reported and the worker runs anyway.
+ */
+ThreadPool::ThreadPool(const ThreadPoolOptions &options)
+    : niceness_(options.niceness), started_(std::chrono::steady_clock::now()) {
+  size_t threads = options.threads == 0 ? hardwareThreads() : options.threads;
+  for (size_t i = 0; i < threads; ++i)
+    queues_.push_back(std::make_unique<Queue>());
+  if (options.pinning == ThreadPinning::Cores) {
+    std::vector<int> order = cpusByCore();
+    if (order.empty())
+      std::cerr << "Thread pinning is not supported here; threads are not "
+                   "pinned\n";
+    for (size_t i = 0; i < threads && !order.empty(); ++i)
+      cpus_.push_back(order[i % order.size()]);
+  }
+  for (size_t i = 1; i < threads; ++i)
+    threads_.emplace_back([this, i]() { workerLoop(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(wakeMutex_);
+    quit_ = true;
+  }
+  wakeCv_.notify_all();
+  for (auto &thread : threads_)
+    thread.join();
+}
+
+/**
+ * @brief Counts the CPUs in the process's affinity mask, so a job confined
+ * to part of a shared machine (taskset, cgroup cpusets) does not start a
+ * thread for every CPU of the machine.
+ */
+size_t ThreadPool::hardwareThreads() {
+#if defined(__linux__)
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0 &&
+      CPU_COUNT(&allowed) > 0)
+    return size_t(CPU_COUNT(&allowed));
+#endif
+  size_t n = std::thread::hardware_concurrency();
+  return n == 0 ? 4 : n;
+}
+
+bool ThreadPool::setSharedOptions(const ThreadPoolOptions &options) {
+  std::lock_guard<std::mutex> lock(sharedMutex);
+  if (sharedStarted)
+    return false;
+  sharedOptions = options;
+  return true;
+}
+
+ThreadPool &ThreadPool::shared() {
+  static ThreadPool pool([] {
+    std::lock_guard<std::mutex> lock(sharedMutex);
+    sharedStarted = true;
+    return sharedOptions;
+  }());
+  return pool;
+}
+
+std::vector<ThreadPool::WorkerLoad> ThreadPool::load() const {
+  std::vector<WorkerLoad> load;
+  for (size_t i = 0; i < size(); ++i) {
+    double cpuSeconds = -1.0;
+#if defined(__linux__)
+    clockid_t clock;
+    timespec time;
+    if (i > 0 &&
+        pthread_getcpuclockid(
+            const_cast<std::thread &>(threads_[i - 1]).native_handle(),
+            &clock) == 0 &&
+        clock_gettime(clock, &time) == 0)
+      cpuSeconds = double(time.tv_sec) + double(time.tv_nsec) * 1e-9;
+#endif
+    load.push_back({double(queues_[i]->busyNanos.load()) * 1e-9, cpuSeconds,
+                    queues_[i]->chunks.load(),
+                    i > 0 && i < cpus_.size() ? cpus_[i] : -1});
+  }
+  return load;
+}
+
+double ThreadPool::uptimeSeconds() const {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       started_)
+      .count();
+}
+
+std::ostream &operator<<(std::ostream &os, const ThreadPool &pool) {
+  const double uptime = pool.uptimeSeconds();
+  const std::vector<ThreadPool::WorkerLoad> load = pool.load();
+  os << "pool: " << load.size() << " threads over " << std::fixed
+     << std::setprecision(2) << uptime << " s";
+  for (size_t i = 0; i < load.size(); ++i) {
+    os << "\n  worker " << i << ": " << std::setprecision(1)
+       << 100.0 * load[i].busySeconds / std::max(uptime, 1e-9) << "% busy, ";
+    if (load[i].cpuSeconds >= 0.0)
+      os << 100.0 * load[i].cpuSeconds / std::max(uptime, 1e-9)
+         << "% on cpu, ";
+    os << load[i].chunks << " chunks";
+    if (i == 0)
+      os << " (calling threads)";
+    else if (load[i].cpu >= 0)
+      os << ", cpu " << load[i].cpu;
+  }
+  return os << std::defaultfloat;
+}
+
+/**
+ * @brief Deals the chunks out, wakes the workers, works through the chunks
+ * of this call alongside them and waits for the last one to finish.
+ *
+ * @param count Number of items.
+ * @param grain Items per chunk (the last chunk may be shorter).
+ * @param fn Called once per chunk with its item range and worker index.
+ */
+void ThreadPool::forkJoin(size_t count, size_t grain, const Chunk &fn) {
+  if (count == 0)
+    return;
+  grain = std::max<size_t>(1, grain);
+  const size_t chunks = (count + grain - 1) / grain;
+  const size_t self = currentPool == this ? currentWorker : 0;
+  if (chunks == 1 || size() == 1) {
+    const auto start = beginRun();
+    for (size_t begin = 0; begin < count; begin += grain)
+      fn(begin, std::min(count, begin + grain), self);
+    endRun(self, start, chunks);
+    return;
+  }
+
+  Job job;
+  job.fn = &fn;
+  job.remaining.store(chunks);
+  // Contiguous runs keep neighbouring chunks on one thread until stolen;
+  // the first run goes to the caller's own deque.
+  const size_t participants = size();
+  for (size_t k = 0; k < participants; ++k) {
+    size_t first = chunks * k / participants;
+    size_t last = chunks * (k + 1) / participants;
+    Queue &queue = *queues_[(self + k) % participants];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    for (size_t c = first; c < last; ++c)
+      queue.ranges.push_back(
+          {&job, c * grain, std::min(count, (c + 1) * grain)});
+  }
+  {
+    std::lock_guard<std::mutex> lock(wakeMutex_);
+    ++generation_;
+  }
+  wakeCv_.notify_all();
+
+  Range range;
+  while (take(self, &job, range))
+    run(range, self);
+  const auto waitStart = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(job.mutex);
+  job.cv.wait(lock, [&job] { return job.done; });
+  if (runDepth > 0)
+    nestedWaitNanos += uint64_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - waitStart)
+            .count());
+}
+
+/**
+ * @brief Pins the calling pool thread to its CPU and sets its niceness.
+ * Linux schedules threads individually, so both only affect this thread.
+ */
+void ThreadPool::placeWorker(size_t worker) const {
+#if defined(__linux__)
+  if (worker < cpus_.size()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus_[worker], &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+      std::cerr << "Could not pin worker " << worker << " to cpu "
+                << cpus_[worker] << "\n";
+  }
+  if (niceness_ != 0 &&
+      setpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid)), niceness_) != 0)
+    std::cerr << "Could not set niceness " << niceness_ << " of worker "
+              << worker << "\n";
+#else
+  (void)worker;
+#endif
+}
+
+void ThreadPool::workerLoop(size_t worker) {
+  currentPool = this;
+  currentWorker = worker;
+  placeWorker(worker);
+  size_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(wakeMutex_);
+      wakeCv_.wait(lock, [&] { return quit_ || generation_ != seen; });
+      if (quit_)
+        return;
+      seen = generation_;
+    }
+    Range range;
+    while (take(worker, nullptr, range))
+      run(range, worker);
+  }
+}
+
+/**
+ * @brief Pops from the front of the worker's own deque, or steals from the
+ * back of another one, starting with its neighbour. With job set, only
+ * chunks of that call are taken.
+ */
+bool ThreadPool::take(size_t worker, const Job *job, Range &range) {
+  auto matches = [job](const Range &r) { return !job || r.job == job; };
+  {
+    Queue &own = *queues_[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    auto it = std::find_if(own.ranges.begin(), own.ranges.end(), matches);
+    if (it != own.ranges.end()) {
+      range = *it;
+      own.ranges.erase(it);
+      return true;
+    }
+  }
+  for (size_t k = 1; k < size(); ++k) {
+    Queue &victim = *queues_[(worker + k) % size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    auto it =
+        std::find_if(victim.ranges.rbegin(), victim.ranges.rend(), matches);
+    if (it != victim.ranges.rend()) {
+      range = *it;
+      victim.ranges.erase(std::next(it).base());
+      return true;
+    }
+  }
+  return false;
+}
+
+std::chrono::steady_clock::time_point ThreadPool::beginRun() {
+  if (runDepth++ == 0)
+    nestedWaitNanos = 0;
+  return std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Books chunks run since beginRun() on the worker. Nested chunks run
+ * inside the outermost one, which accounts for their time.
+ */
+void ThreadPool::endRun(size_t worker,
+                        std::chrono::steady_clock::time_point start,
+                        size_t chunks) {
+  Queue &own = *queues_[worker];
+  own.chunks.fetch_add(chunks);
+  if (--runDepth == 0) {
+    uint64_t elapsed = uint64_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+    own.busyNanos.fetch_add(elapsed - std::min(elapsed, nestedWaitNanos));
+  }
+}
+
+/**
+ * @brief Runs one chunk. The thread finishing the last chunk of a call
+ * opens its latch; the caller cannot return before that lock is released.
+ */
+void ThreadPool::run(const Range &range, size_t worker) {
+  Job &job = *range.job;
+  const auto start = beginRun();
+  (*job.fn)(range.begin, range.end, worker);
+  endRun(worker, start, 1);
+  if (job.remaining.fetch_sub(1) == 1) {
+    std::lock_guard<std::mutex> lock(job.mutex);
+    job.done = true;
+    job.cv.notify_all();
+  }
+}
@@ -1,5 +1,8 @@
 #include "VertexProcessor.hpp"
-#include <thread>
+#include "Parallel.hpp"
+
+// Vertices per chunk of transformVertices.
+static constexpr size_t kTransformGrain = 1 << 15;
 
 /**
  * @brief Construct a VertexProcessor with given model, view, and projection
@@ -28,34 +31,55 @@ void VertexProcessor::setProjectionMatrix(const MiniGLM::mat4 &projection) {
  * @brief Applies the Model-View-Projection (MVP) trasformation to a list of
  * vertices. It takes a collection of object-space vertices, converts each into
  * a homogeneous coordinate (vec4) with w=1.0, and multiplies it by the combined
- * MVP matrix to obtain the transformed vertices in clip space.
+ * MVP matrix to obtain the transformed vertices in clip space. Chunks of
+ * the list run on the shared pool.
  *
  * @param vertices The input vertices in object space as a vector of Vec3
+ * @param cancel Checked before every chunk.
  * @return std::vector<MiniGLM::vec4>  A vector containing the transformed
  * vertices in clip space.
  */
 std::vector<MiniGLM::vec4> VertexProcessor::transformVertices(
-    const std::vector<MiniGLM::vec3> &vertices) const {
+    const std::vector<MiniGLM::vec3> &vertices,
+    const CancelToken &cancel) const {
   std::vector<MiniGLM::vec4> transformed(vertices.size());
-  MiniGLM::mat4 mvp = projection_ * view_ * model_;
-
-  const size_t numThreads = std::thread::hardware_concurrency();
-  std::vector<std::thread> threads(numThreads);
-
-  auto worker = [&](size_t start, size_t end) {
-    for (size_t i = start; i < end; ++i) {
-      transformed[i] = mvp * MiniGLM::vec4(vertices[i], 1.0f);
-    }
-  };
+  Parallel::parallelFor(vertices.size(), kTransformGrain,
+                        [&](size_t begin, size_t end, size_t) {
+                          if (!cancel.cancelled())
+                            transformRange(vertices, begin, end, transformed);
+                        });
+  return transformed;
+}
 
-  size_t chunkSize = vertices.size() / numThreads;
-  for (size_t t = 0; t < numThreads; ++t) {
-    size_t start = t * chunkSize;
-    size_t end = (t + 1 == numThreads) ? vertices.size() : start + chunkSize;
-    threads[t] = std::thread(worker, start, end);
-  }
-  for (auto &th : threads)
-    th.join();
+/**
+ * @brief Transforms a contiguous range of vertices to clip space without
+ * spawning threads, for callers that already split the work (e.g. per edge
+ * cluster).
+ *
+ * @param vertices The input vertices in object space.
+ * @param begin First vertex to transform.
+ * @param end One past the last vertex to transform.
+ * @param out Receives the clip-space vertices at the same indices.
+ */
+void VertexProcessor::transformRange(const std::vector<MiniGLM::vec3> &vertices,
+                                     size_t begin, size_t end,
+                                     std::vector<MiniGLM::vec4> &out) const {
+  MiniGLM::mat4 mvp = projection_ * view_ * model_;
+  for (size_t i = begin; i < end; ++i)
+    out[i] = mvp * MiniGLM::vec4(vertices[i], 1.0f);
+}
 
-  return transformed;
-}
\ No newline at end of file
+/**
+ * @brief Returns the camera position in model space as a homogeneous point.
+ *
+ * The eye is the point the projection maps to x = y = w = 0. For projections
+ * whose w row is (0, 0, a, b) that is (0, 0, b, -a) in view space: the origin
+ * for perspective, the +z direction at infinity for orthographic. It is
+ * taken back to model space with the inverse model-view matrix, so a plane
+ * (n, d) faces the camera iff dot((n, d), eye) > 0 for both kinds.
+ */
+MiniGLM::vec4 VertexProcessor::eyePosition() const {
+  MiniGLM::vec4 eyeView(0.0f, 0.0f, projection_.at(3, 3),
+                        -projection_.at(2, 3));
+  return MiniGLM::inverse(view_ * model_) * eyeView;
+}
@@ -1,22 +1,60 @@
 #include "WireframeApp.hpp"
+#include "TaskGraph.hpp"
+#include <QMetaObject>
 #include <QMouseEvent>
 #include <QPainter>
+#include <QScreen>
+#include <QString>
 #include <QWheelEvent>
 #include <QtMath>
-#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
 #include <iostream>
+#include <limits>
 
 WireframeApp::WireframeApp(const std::vector<MiniGLM::vec3> &vertices,
                            const std::vector<std::pair<int, int>> &edges,
-                           int width, int height, QWidget *parent)
-    : QWidget(parent), m_width(width), m_height(height), m_frameBuffer(nullptr),
-      m_image(nullptr), cam_dist_(30.0f),
+                           const std::vector<int> &triangles,
+                           const std::vector<MiniGLM::vec4> &facePlanes,
+                           const std::vector<std::pair<int, int>> &edgeFaces,
+                           int width, int height,
+                           const RenderOptions &options, QWidget *parent)
+    : QWidget(parent), m_width(width), m_height(height), cam_dist_(30.0f),
+      renderWidth_(width), renderHeight_(height),
       processor(MiniGLM::mat4::identity(), MiniGLM::mat4::identity(),
                 MiniGLM::mat4::identity()),
-      raster(m_width, m_height), nearClipper(Clipper(0.01f)),
-      screenClipper(Clipper(0, 0, m_width - 1, m_height - 1)),
-      vertices(vertices), edges(edges) {
-  allocateBuffer();
+      raster(m_width, m_height), clipStage(m_width, m_height),
+      vertices(vertices),
+      triangles(options.hiddenLine ? triangles : std::vector<int>()),
+      bvh(EdgeBvh::loadOrBuild(vertices, edges, options.bvhCache)),
+      options_(options) {
+  clusterClipSpace.resize(bvh.clusters().vertices().size());
+  // The optional per-mesh structures are independent of each other.
+  TaskGraph setup;
+  if (!options_.occluderFile.empty())
+    setup.add(
+        [&] { occlusion = OcclusionBuffer::load(options_.occluderFile); });
+  else if (options_.occlusionCulling)
+    setup.add([&] {
+      occlusion = OcclusionBuffer::largestFaces(vertices, triangles);
+    });
+  if (options_.lod)
+    setup.add([&] {
+      lod = EdgeLod(bvh.clusters());
+      lodClipSpace.resize(lod.vertices().size());
+    });
+  if (options_.cullBackfaces || options_.outlineOnly)
+    setup.add([&] {
+      edgeFilter =
+          std::make_unique<EdgeFilter>(facePlanes, edgeFaces, bvh.clusters());
+      edgeFilter->setCullBackfaces(options_.cullBackfaces);
+      edgeFilter->setOutlineOnly(options_.outlineOnly, options_.creaseAngle);
+    });
+  setup.run();
+  raster.setGammaCorrect(options_.gammaCorrect);
+  clipStage.setGuardBand(options_.guardBand);
   center = computeCenter(vertices);
   eye = center + MiniGLM::vec3(0, 0, cam_dist_);
   model = MiniGLM::mat4::identity();
@@ -32,193 +70,554 @@ WireframeApp::WireframeApp(const std::vector<MiniGLM::vec3> &vertices,
   updateCameraQt();
 
   processor.setModelMatrix(model);
-  processor.setViewMatrix(view);
-  processor.setProjectionMatrix(proj);
   setMouseTracking(true);
 
-  size_t numThreads = std::thread::hardware_concurrency();
-  if (numThreads == 0)
-    numThreads = 4;
-
-  for (size_t t = 0; t < numThreads; ++t) {
-    threadPool.emplace_back([this]() {
-      while (true) {
-        std::pair<size_t, size_t> task;
-        {
-          std::unique_lock<std::mutex> lock(queueMutex);
-          queueCV.wait(
-              lock, [this] { return !workQueue.empty() || quitFlag.load(); });
+  workerSegments.resize(pool.size());
+  workerBandSegments.assign(
+      pool.size(), std::vector<std::vector<ScreenSegment>>(
+                       pool.size() * kAliasedBandsPerWorker));
+  workerClipStats.resize(pool.size());
+  workerDedup.resize(pool.size());
+  resizeFrameTargets(renderWidth_, renderHeight_);
+  allocateWorkerBuffers(renderWidth_, renderHeight_);
+  interactiveScale_ = options_.interactiveScale;
+
+  idleTimer_.setSingleShot(true);
+  idleTimer_.setInterval(kIdleRefineMs);
+  connect(&idleTimer_, &QTimer::timeout, this, [this] { requestFrame(); });
+  frameTimer_.setTimerType(Qt::PreciseTimer);
+  connect(&frameTimer_, &QTimer::timeout, this, [this] { frameTick(); });
+
+  requestFrame();
+  renderThread_ = std::thread([this] { renderLoop(); });
+}
 
-          if (quitFlag.load())
-            break;
+WireframeApp::~WireframeApp() {
+  {
+    std::lock_guard<std::mutex> lock(requestMutex_);
+    stopRendering_ = true;
+    // Abandon the frame in flight rather than wait for it.
+    generation_.fetch_add(1);
+  }
+  requestCv_.notify_one();
+  renderThread_.join();
+}
 
-          task = workQueue.front();
-          workQueue.pop();
-        }
-        this->drawEdgesInRange(workerClipSpace, task.first, task.second,
-                               workerColor, workerNearEpsilon, workerNdcLimit);
-        --tasksPending;
-      }
-    });
+/**
+ * @brief Hands the current camera and window size to the render thread.
+ * Called from the GUI thread; never blocks on a frame in progress.
+ *
+ * @param interactive Draw a fast, reduced-resolution frame and schedule a
+ * full-quality one for when the view stays still.
+ */
+void WireframeApp::requestFrame(bool interactive) {
+  if (interactive)
+    idleTimer_.start();
+  {
+    std::lock_guard<std::mutex> lock(requestMutex_);
+    request_ = {view, proj, m_width, m_height, interactive};
+    ++requested_;
+    if (!interactive || !renderingInteractive_)
+      generation_.fetch_add(1);
   }
+  requestCv_.notify_one();
+}
 
-  renderModel();
+/**
+ * @brief Asks for an interactive frame after the camera or window size
+ * changed. The first change after a pause is sent at once; later ones are
+ * only recorded, and frameTick() sends the camera as it stands once per
+ * display refresh. A 1000 Hz mouse thus costs no more frames than a 60 Hz
+ * one.
+ */
+void WireframeApp::scheduleFrame() {
+  if (frameTimer_.isActive()) {
+    inputPending_ = true;
+    return;
+  }
+  requestFrame(true);
+  const QScreen *display = screen();
+  double hz = display ? display->refreshRate() : 60.0;
+  frameTimer_.start(int(std::lround(1000.0 / std::max(hz, 1.0))));
 }
 
-WireframeApp::~WireframeApp() { freeBuffer(); }
+void WireframeApp::frameTick() {
+  if (!inputPending_) {
+    frameTimer_.stop();
+    return;
+  }
+  inputPending_ = false;
+  requestFrame(true);
+}
 
-void WireframeApp::renderModel() {
-  auto clip_space = processor.transformVertices(vertices);
-  raster.clear(Color(0, 0, 0, 255));
-  drawEdgesMultithreaded(clip_space);
-  const auto &rasterBuffer = raster.getBuffer();
-  for (int y = 0; y < m_height; ++y) {
-    for (int x = 0; x < m_width; ++x) {
-      int idx = y * m_width + x;
-      const Color &color = rasterBuffer[idx];
-      int fbIdx = idx * 4;
-      m_frameBuffer[fbIdx + 0] = color.r;
-      m_frameBuffer[fbIdx + 1] = color.g;
-      m_frameBuffer[fbIdx + 2] = color.b;
-      m_frameBuffer[fbIdx + 3] = color.a;
+/**
+ * @brief Body of the render thread: sleeps until a request newer than the
+ * last frame arrives and renders it. A request that comes in while a frame
+ * is being drawn cancels it (unless both are interactive); the workers
+ * drop their remaining chunks and the loop starts over with the newest
+ * request.
+ */
+void WireframeApp::renderLoop() {
+  uint64_t rendered = 0;
+  while (true) {
+    FrameRequest request;
+    {
+      std::unique_lock<std::mutex> lock(requestMutex_);
+      requestCv_.wait(lock, [&] {
+        return stopRendering_ || requested_ != rendered;
+      });
+      if (stopRendering_)
+        return;
+      request = request_;
+      rendered = requested_;
+      renderingInteractive_ = request.interactive;
+      frameCancel_ = CancelToken(generation_, generation_.load());
     }
+    renderModel(request);
   }
-  updateImage();
-  update();
 }
 
-void WireframeApp::drawEdgesMultithreaded(
-    const std::vector<MiniGLM::vec4> &clip_space) {
-  size_t numThreads = threadPool.size();
-  size_t edgesPerThread = edges.size() / numThreads;
-
-  // Store arguments for workers
-  workerClipSpace = clip_space;
-  workerColor = Color(255, 255, 255);
-  workerNearEpsilon = 1e-3f;
-  workerNdcLimit = 100.0f;
-  tasksPending = numThreads;
+/**
+ * @brief Renders one frame on the render thread and publishes it to
+ * paintEvent, unless frameCancel_ fires first. A new frame size
+ * reallocates the size-dependent targets first.
+ *
+ * Interactive frames shrink the window size by interactiveScale_ and draw
+ * aliased lines straight into the frame, skipping the per-worker buffers;
+ * paintEvent stretches them to the window. After each one the scale is
+ * nudged so the next takes about kInteractiveBudgetMs. A smaller frame
+ * also makes --lod pick coarser levels, which keeps big meshes in budget.
+ *
+ * Full-quality frames draw the clusters largest on screen first, in
+ * batches, and publish what has accumulated every kRefineSliceMs until
+ * all of them are drawn. A mesh that fits in one slice is published once.
+ */
+void WireframeApp::renderModel(const FrameRequest &request) {
+  if (request.width <= 0 || request.height <= 0)
+    return;
+  const auto start = std::chrono::steady_clock::now();
+  fastFrame_ = request.interactive;
+  int width = request.width, height = request.height;
+  if (fastFrame_) {
+    // Steps of 1/32 keep small adjustments from reallocating every frame.
+    float scale = std::round(interactiveScale_ * 32.0f) / 32.0f;
+    width = std::max(1, int(float(width) * scale + 0.5f));
+    height = std::max(1, int(float(height) * scale + 0.5f));
+  }
+  if (width != renderWidth_ || height != renderHeight_)
+    resizeFrameTargets(width, height);
+  if (!fastFrame_)
+    allocateWorkerBuffers(width, height);
+  processor.setViewMatrix(request.view);
+  processor.setProjectionMatrix(request.proj);
 
-  {
-    std::lock_guard<std::mutex> lock(queueMutex);
-    for (size_t t = 0; t < numThreads; ++t) {
-      size_t start = t * edgesPerThread;
-      size_t end =
-          (t == numThreads - 1) ? edges.size() : (start + edgesPerThread);
-      workQueue.push({start, end});
-    }
+  raster.clear(Color(0, 0, 0, 255));
+  if (depthBuffer) {
+    // The faces still need every vertex; only the edges are clustered.
+    auto clip_space = processor.transformVertices(vertices, frameCancel_);
+    depthBuffer->clear();
+    depthBuffer->rasterize(clip_space, triangles, kNearW, frameCancel_);
+    if (frameCancel_.cancelled())
+      return;
+  }
+  // Whole subtrees of clusters outside the frustum are dropped before any of
+  // their vertices are transformed.
+  const MiniGLM::mat4 mvp = processor.modelViewProjection();
+  // None of the per-frame stages below polls on its own, so the frame is
+  // checked for cancellation between them.
+  culledEdges = bvh.cullFrustum(mvp, visibleClusters);
+  occludedEdges = 0;
+  if (occlusion && !frameCancel_.cancelled()) {
+    occlusion->render(mvp);
+    occludedEdges = occlusion->cull(mvp, bvh.clusters(), visibleClusters);
+  }
+  if (frameCancel_.cancelled())
+    return;
+  if (edgeFilter) {
+    edgeFilter->update(processor.eyePosition());
+    if (frameCancel_.cancelled())
+      return;
+  }
+  clearWorkerBuffers();
+
+  if (fastFrame_) {
+    drawEdgesMultithreaded(0, visibleClusters.size());
+    if (frameCancel_.cancelled())
+      return;
+    publishFrame(1.0f);
+    // Pixel count, and with it most of the frame time, goes with scale^2.
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    float step = float(std::sqrt(kInteractiveBudgetMs / std::max(ms, 0.1)));
+    interactiveScale_ =
+        std::clamp(interactiveScale_ * std::clamp(step, 0.8f, 1.25f),
+                   kMinInteractiveScale, options_.interactiveScale);
+    return;
   }
-  queueCV.notify_all();
 
-  // Wait for all threads to finish their chunk
-  while (tasksPending > 0) {
-    std::this_thread::sleep_for(
-        std::chrono::microseconds(50)); // Avoid harsh busy waiting
+  prioritizeClusters(mvp);
+  if (frameCancel_.cancelled())
+    return;
+  size_t totalEdges = 0, drawnEdges = 0;
+  for (uint32_t index : visibleClusters)
+    totalEdges += bvh.clusters().clusters()[index].edgeCount;
+  const size_t batch = pool.size() * kRefineBatchPerWorker;
+  auto sliceStart = start;
+  for (size_t begin = 0; begin < visibleClusters.size();) {
+    size_t end = std::min(visibleClusters.size(), begin + batch);
+    drawEdgesMultithreaded(begin, end);
+    if (frameCancel_.cancelled())
+      return;
+    for (; begin < end; ++begin)
+      drawnEdges += bvh.clusters().clusters()[visibleClusters[begin]].edgeCount;
+    if (begin == visibleClusters.size())
+      break;
+    const auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double, std::milli>(now - sliceStart).count() <
+        kRefineSliceMs)
+      continue;
+    if (frameCancel_.cancelled())
+      return;
+    publishFrame(float(drawnEdges) / float(totalEdges));
+    sliceStart = std::chrono::steady_clock::now();
+  }
+  if (options_.printStats) {
+    ClipStats frameStats;
+    frameStats.culled = culledEdges;
+    frameStats.occluded = occludedEdges;
+    for (const ClipStats &s : workerClipStats)
+      frameStats += s;
+    std::cout << frameStats << "\n";
   }
+  publishFrame(1.0f);
 }
 
-void WireframeApp::drawEdgesInRange(
-    const std::vector<MiniGLM::vec4> &clip_space, size_t start, size_t end,
-    const Color &color, float near_epsilon, float ndc_limit) {
-  for (size_t i = start; i < end; ++i) {
-    MiniGLM::vec4 clipV0 = clip_space[edges[i].first];
-    MiniGLM::vec4 clipV1 = clip_space[edges[i].second];
-    if (!nearClipper.clipLineNearPlane(clipV0, clipV1))
-      continue;
-    if (clipV0.w < near_epsilon || clipV1.w < near_epsilon)
-      continue;
+/**
+ * @brief Orders visibleClusters by the screen-space diagonal of their
+ * bounding boxes, largest first. Clusters hold a fixed number of edges, so
+ * this draws the longest projected edges, which shape the image, before
+ * the fine detail. Boxes reaching behind the eye count as largest. A
+ * cancelled frame skips the sort.
+ */
+void WireframeApp::prioritizeClusters(const MiniGLM::mat4 &mvp) {
+  const std::vector<EdgeCluster> &clusters = bvh.clusters().clusters();
+  clusterPriority.resize(visibleClusters.size());
+  Parallel::parallelFor(
+      visibleClusters.size(), kClustersPerPriorityChunk,
+      [&](size_t begin, size_t end, size_t) {
+        for (size_t k = begin; k < end; ++k) {
+          const EdgeCluster &c = clusters[visibleClusters[k]];
+          MiniGLM::vec2 lo(std::numeric_limits<float>::infinity());
+          MiniGLM::vec2 hi(-std::numeric_limits<float>::infinity());
+          float size = std::numeric_limits<float>::infinity();
+          bool inFront = true;
+          for (int i = 0; i < 8 && inFront; ++i) {
+            MiniGLM::vec4 p =
+                mvp * MiniGLM::vec4(i & 1 ? c.boundsMax.x : c.boundsMin.x,
+                                    i & 2 ? c.boundsMax.y : c.boundsMin.y,
+                                    i & 4 ? c.boundsMax.z : c.boundsMin.z,
+                                    1.0f);
+            inFront = p.w > kNearW;
+            MiniGLM::vec2 ndc(p.x / p.w, p.y / p.w);
+            lo = MiniGLM::vec2(std::min(lo.x, ndc.x), std::min(lo.y, ndc.y));
+            hi = MiniGLM::vec2(std::max(hi.x, ndc.x), std::max(hi.y, ndc.y));
+          }
+          if (inFront)
+            size = std::hypot(0.5f * (hi.x - lo.x) * renderWidth_,
+                              0.5f * (hi.y - lo.y) * renderHeight_);
+          clusterPriority[k] = {size, visibleClusters[k]};
+        }
+      });
+  if (frameCancel_.cancelled())
+    return;
+  Parallel::sort(clusterPriority.begin(), clusterPriority.end(),
+                 std::greater<>());
+  for (size_t k = 0; k < clusterPriority.size(); ++k)
+    visibleClusters[k] = clusterPriority[k].second;
+}
 
-    float ndc_x0 = clipV0.x / clipV0.w;
-    float ndc_y0 = clipV0.y / clipV0.w;
-    float ndc_x1 = clipV1.x / clipV1.w;
-    float ndc_y1 = clipV1.y / clipV1.w;
+/**
+ * @brief Resolves what has been drawn so far into the frame and hands it
+ * to paintEvent. The private buffers keep accumulating afterwards, so a
+ * partial frame is resolved over a cleared frame each time.
+ */
+void WireframeApp::publishFrame(float progress) {
+  if (!fastFrame_ && options_.rasterMode != RasterMode::Shared)
+    raster.clear(Color(0, 0, 0, 255));
+  // Interactive frames drew straight into raster.
+  if (!fastFrame_ && options_.rasterMode == RasterMode::PrivateCoverage)
+    raster.resolveCoverage(workerCoverage, workerColor,
+                           options_.coverageMerge);
+  else if (!fastFrame_ && options_.rasterMode == RasterMode::Density)
+    raster.resolveDensity(workerDensity, workerColor);
+  const auto &rasterBuffer = raster.getBuffer();
+  Frame &frame = frames_.writeSlot();
+  frame.width = renderWidth_;
+  frame.height = renderHeight_;
+  frame.progress = progress;
+  frame.pixels.resize(size_t(renderWidth_) * renderHeight_ * 4);
+  pool.forkJoin(size_t(renderHeight_), kRowsPerChunk,
+                [&](size_t yBegin, size_t yEnd, size_t) {
+                  for (size_t y = yBegin; y < yEnd; ++y) {
+                    for (int x = 0; x < renderWidth_; ++x) {
+                      size_t idx = y * renderWidth_ + x;
+                      const Color &color = rasterBuffer[idx];
+                      size_t fbIdx = idx * 4;
+                      frame.pixels[fbIdx + 0] = color.r;
+                      frame.pixels[fbIdx + 1] = color.g;
+                      frame.pixels[fbIdx + 2] = color.b;
+                      frame.pixels[fbIdx + 3] = color.a;
+                    }
+                  }
+                });
+  frames_.publish();
+  // update() must run on the GUI thread.
+  QMetaObject::invokeMethod(
+      this, [this] { update(); }, Qt::QueuedConnection);
+}
 
-    auto excess = [](float v) { return std::max(0.0f, fabs(v) - 1.0f); };
-    float ndc_x0_excess = excess(ndc_x0);
-    float ndc_y0_excess = excess(ndc_y0);
-    float ndc_x1_excess = excess(ndc_x1);
-    float ndc_y1_excess = excess(ndc_y1);
+/**
+ * @brief Resets the per-worker buffers and statistics of every pool
+ * thread at the start of a frame; any thread may reset any worker's.
+ */
+void WireframeApp::clearWorkerBuffers() {
+  workerColor = Color(255, 255, 255);
+  const int bands = int(pool.size() * kAliasedBandsPerWorker);
+  bandRows = std::max(1, (renderHeight_ + bands - 1) / bands);
+  pool.forkJoin(pool.size(), 1, [this](size_t begin, size_t end, size_t) {
+    for (size_t slot = begin; slot < end; ++slot) {
+      // Interactive frames do not use the worker buffers.
+      if (fastFrame_)
+        for (std::vector<ScreenSegment> &band : workerBandSegments[slot])
+          band.clear();
+      else if (options_.rasterMode == RasterMode::PrivateCoverage)
+        workerCoverage[slot].clear();
+      else if (options_.rasterMode == RasterMode::Density)
+        workerDensity[slot].clear();
+      workerClipStats[slot] = ClipStats();
+    }
+  });
+}
 
-    float threshold = ndc_limit - 1.0f;
+/**
+ * @brief Draws visibleClusters[begin, end) on the pool. The chunks are
+ * much smaller than one thread's share, so workers that run out steal from
+ * the others; each chunk draws into the private buffers of the worker
+ * running it. Interactive frames have no private buffers: their chunks only
+ * clip, and drawAliasedBands() draws afterwards. The calling thread works
+ * too and returns once every chunk is done.
+ */
+void WireframeApp::drawEdgesMultithreaded(size_t begin, size_t end) {
+  size_t grain =
+      std::max<size_t>(1, (end - begin) / (pool.size() * kChunksPerWorker));
+  pool.forkJoin(end - begin, grain,
+                [this, begin](size_t first, size_t last, size_t worker) {
+                  drawEdgesInRange(begin + first, begin + last, workerColor,
+                                   worker);
+                });
+  if (fastFrame_)
+    drawAliasedBands();
+}
 
-    bool p0_far = std::max(ndc_x0_excess, ndc_y0_excess) > threshold;
-    bool p1_far = std::max(ndc_x1_excess, ndc_y1_excess) > threshold;
+/**
+ * @brief Draws the segments an interactive frame's chunks sorted into row
+ * bands. Each band is drawn by one worker and its lines are cut to the
+ * band's rows, so the workers share the raster without writing the same
+ * pixel.
+ */
+void WireframeApp::drawAliasedBands() {
+  pool.forkJoin(
+      pool.size() * kAliasedBandsPerWorker, 1,
+      [this](size_t first, size_t last, size_t) {
+        for (size_t band = first; band < last; ++band) {
+          const int rowBegin = int(band) * bandRows;
+          const int rowEnd = rowBegin + bandRows;
+          for (const auto &bands : workerBandSegments) {
+            const std::vector<ScreenSegment> &segments = bands[band];
+            for (size_t i = 0; i < segments.size(); ++i) {
+              if (i % kSegmentsPerCancelCheck == 0 &&
+                  frameCancel_.cancelled())
+                return;
+              const ScreenSegment &seg = segments[i];
+              raster.drawLineAliased(toPixel(seg.p0), toPixel(seg.p1),
+                                     workerColor, depthBuffer.get(), seg.z0,
+                                     seg.z1, rowBegin, rowEnd);
+            }
+          }
+        }
+      });
+}
 
-    if (p0_far || p1_far)
+void WireframeApp::drawEdgesInRange(size_t start, size_t end,
+                                    const Color &color, size_t slot) {
+  const RasterMode mode = options_.rasterMode;
+  const float lineWidth = options_.lineWidth;
+
+  // Transform and clip the visible clusters first (each owns a disjoint
+  // vertex range, so workers never write the same slot); the raster loop
+  // below then walks a dense list of on-screen segments.
+  std::vector<ScreenSegment> &segments = workerSegments[slot];
+  segments.clear();
+  const EdgeClusters &clusters = bvh.clusters();
+  const MiniGLM::mat4 mvp = processor.modelViewProjection();
+  for (size_t k = start; k < end; ++k) {
+    if (frameCancel_.cancelled())
+      return;
+    const EdgeCluster &c = clusters.clusters()[visibleClusters[k]];
+    // Distant clusters are drawn from a coarser level. Its flags are per
+    // full-detail edge, so the options never combine --lod with a filter.
+    int level = lod.selectLevel(mvp, renderWidth_, renderHeight_, c);
+    if (level > 0) {
+      const LodLevel &l = lod.level(visibleClusters[k], level);
+      processor.transformRange(lod.vertices(), l.firstVertex,
+                               l.firstVertex + l.vertexCount, lodClipSpace);
+      clipStage.run(lodClipSpace, lod.edges(), l.firstEdge,
+                    l.firstEdge + l.edgeCount, segments,
+                    workerClipStats[slot]);
+      workerClipStats[slot].simplified += c.edgeCount - l.edgeCount;
       continue;
+    }
+    processor.transformRange(clusters.vertices(), c.firstVertex,
+                             c.firstVertex + c.vertexCount, clusterClipSpace);
+    clipStage.run(clusterClipSpace, clusters.edges(), c.firstEdge,
+                  c.firstEdge + c.edgeCount, segments, workerClipStats[slot],
+                  edgeFilter.get());
+  }
 
-    MiniGLM::ivec2 p0, p1;
-    p0.x = static_cast<int>((ndc_x0 * 0.5f + 0.5f) * m_width);
-    p0.y = static_cast<int>((1.0f - (ndc_y0 * 0.5f + 0.5f)) * m_height);
-    p1.x = static_cast<int>((ndc_x1 * 0.5f + 0.5f) * m_width);
-    p1.y = static_cast<int>((1.0f - (ndc_y1 * 0.5f + 0.5f)) * m_height);
+  // Coinciding segments of this chunk's clusters are drawn once.
+  if (options_.dedup)
+    workerDedup[slot].run(segments, workerClipStats[slot]);
+
+  for (size_t i = 0; i < segments.size(); ++i) {
+    if (i % kSegmentsPerCancelCheck == 0 && frameCancel_.cancelled())
+      return;
+    const ScreenSegment &seg = segments[i];
+    const MiniGLM::vec2 &f0 = seg.p0, &f1 = seg.p1;
+    const float z0 = seg.z0, z1 = seg.z1;
+
+    if (fastFrame_) {
+      // Drawn later by drawAliasedBands(), in every band the line reaches.
+      int yLo = std::max(0, std::min(toPixel(f0).y, toPixel(f1).y));
+      int yHi = std::min(renderHeight_ - 1, std::max(toPixel(f0).y,
+                                                     toPixel(f1).y));
+      for (int band = yLo / bandRows; yLo <= yHi && band <= yHi / bandRows;
+           ++band)
+        workerBandSegments[slot][band].push_back(seg);
+      continue;
+    }
 
-    int dx = p0.x - p1.x, dy = p0.y - p1.y;
-    if ((dx * dx + dy * dy) < 4)
+    if (lineWidth > 1.0f) {
+      const DepthBuffer *depth = depthBuffer.get();
+      if (mode == RasterMode::PrivateCoverage)
+        workerCoverage[slot].drawThickLine(f0, f1, lineWidth, depth, z0, z1);
+      else if (mode == RasterMode::Density)
+        workerDensity[slot].drawThickLine(f0, f1, lineWidth, depth, z0, z1);
+      else
+        raster.drawThickLine(f0, f1, lineWidth, color, depth, z0, z1);
       continue;
+    }
 
-    if (screenClipper.clipLine(p0, p1))
+    MiniGLM::ivec2 p0 = toPixel(f0), p1 = toPixel(f1);
+    if (depthBuffer) {
+      if (mode == RasterMode::PrivateCoverage)
+        workerCoverage[slot].drawLine(p0, p1, z0, z1, *depthBuffer);
+      else if (mode == RasterMode::Density)
+        workerDensity[slot].drawLine(p0, p1, z0, z1, *depthBuffer);
+      else
+        raster.drawLine(p0, p1, z0, z1, color, *depthBuffer);
+    } else if (mode == RasterMode::PrivateCoverage)
+      workerCoverage[slot].drawLine(p0, p1);
+    else if (mode == RasterMode::Density)
+      workerDensity[slot].drawLine(p0, p1);
+    else
       raster.drawLine(p0, p1, color);
   }
 }
 
-void WireframeApp::closeEvent(QCloseEvent *event) {
-  quitFlag.store(true);
-  queueCV.notify_all();
-
-  for (auto &thread : threadPool)
-    if (thread.joinable())
-      thread.join();
-  threadPool.clear();
-
-  event->accept();
-}
+void WireframeApp::closeEvent(QCloseEvent *event) { event->accept(); }
 
 void WireframeApp::paintEvent(QPaintEvent * /*event*/) {
+  // Shows the newest finished frame, stretched while a resize catches up.
+  frames_.acquire();
+  const Frame &frame = frames_.readSlot();
+  if (frame.pixels.empty())
+    return;
+  QImage image(frame.pixels.data(), frame.width, frame.height,
+               QImage::Format_RGBA8888);
   QPainter painter(this);
-  if (m_image)
-    painter.drawImage(rect(), *m_image);
+  painter.drawImage(rect(), image);
+  if (frame.progress < 1.0f) {
+    painter.setPen(Qt::white);
+    painter.drawText(8, 20,
+                     QString("Refining %1%").arg(int(frame.progress * 100)));
+  }
 }
 
 void WireframeApp::resizeEvent(QResizeEvent *event) {
+  // A drag of the window edge sends a storm of these; like mouse moves
+  // they are paced to the display and drawn as interactive frames until
+  // the size settles.
+  const bool resized = event->size().width() != m_width ||
+                       event->size().height() != m_height;
   m_width = event->size().width();
   m_height = event->size().height();
-  freeBuffer();
-  allocateBuffer();
-  raster = Rasterizer(m_width, m_height);
-
   proj = MiniGLM::perspective(MiniGLM::radians(60.0f),
                               float(m_width) / float(m_height), 0.01f, 100.0f);
-  processor.setProjectionMatrix(proj);
-
-  renderModel();
+  if (resized)
+    scheduleFrame();
+  else
+    requestFrame();
 
   QWidget::resizeEvent(event);
 }
 
-void WireframeApp::allocateBuffer() {
-  m_frameBuffer = new uchar[m_width * m_height * 4];
-  std::memset(m_frameBuffer, 0, m_width * m_height * 4);
+/**
+ * @brief Sizes the targets every frame draws into: the color buffer, the
+ * depth buffer for hidden-line removal and the clip viewport. The buffers
+ * only grow, so dragging the window edge or switching between interactive
+ * and full-quality frames reuses their memory.
+ */
+void WireframeApp::resizeFrameTargets(int width, int height) {
+  renderWidth_ = width;
+  renderHeight_ = height;
+  clipStage.setViewport(width, height);
+  raster.resize(width, height);
+  if (depthBuffer)
+    depthBuffer->resize(width, height);
+  else if (options_.hiddenLine)
+    depthBuffer =
+        std::make_unique<DepthBuffer>(width, height, options_.depthBias);
 }
 
-void WireframeApp::freeBuffer() {
-  if (m_image) {
-    delete m_image;
-    m_image = nullptr;
-  }
-  if (m_frameBuffer) {
-    delete[] m_frameBuffer;
-    m_frameBuffer = nullptr;
+/**
+ * @brief Makes the private buffer of every pool thread for the coverage
+ * and density modes match the given size, reusing their memory like
+ * resizeFrameTargets(). Only full-quality frames use them, so interactive
+ * frames leave them alone.
+ */
+void WireframeApp::allocateWorkerBuffers(int width, int height) {
+  if (options_.rasterMode == RasterMode::PrivateCoverage) {
+    if (workerCoverage.empty())
+      for (size_t t = 0; t < pool.size(); ++t)
+        workerCoverage.emplace_back(width, height, options_.coverageMerge);
+    if (workerCoverage[0].width() == width &&
+        workerCoverage[0].height() == height)
+      return;
+    for (CoverageBuffer &buffer : workerCoverage)
+      buffer.resize(width, height);
+  } else if (options_.rasterMode == RasterMode::Density) {
+    if (workerDensity.empty())
+      for (size_t t = 0; t < pool.size(); ++t)
+        workerDensity.emplace_back(width, height);
+    if (workerDensity[0].width() == width &&
+        workerDensity[0].height() == height)
+      return;
+    for (DensityBuffer &buffer : workerDensity)
+      buffer.resize(width, height);
   }
 }
 
-void WireframeApp::updateImage() {
-  if (m_image)
-    delete m_image;
-  m_image =
-      new QImage(m_frameBuffer, m_width, m_height, QImage::Format_RGBA8888);
-}
-
 MiniGLM::vec3
 WireframeApp::computeCenter(const std::vector<MiniGLM::vec3> &vertices) {
   MiniGLM::vec3 minPos(1e9), maxPos(-1e9);
@@ -237,12 +636,21 @@ void WireframeApp::mousePressEvent(QMouseEvent *event) {
   if (event->button() == Qt::LeftButton) {
     rotating_ = true;
     lastMousePos_ = event->pos();
+    pressPos_ = event->pos();
   }
 }
 
 void WireframeApp::mouseReleaseEvent(QMouseEvent *event) {
   if (event->button() == Qt::LeftButton) {
     rotating_ = false;
+    // A click without dragging picks the edge under the cursor.
+    if ((event->pos() - pressPos_).manhattanLength() < 3) {
+      long edge = bvh.pickEdge(proj * view * model, m_width, m_height,
+                               event->pos().x() + 0.5f,
+                               event->pos().y() + 0.5f);
+      if (edge >= 0)
+        std::cout << "Picked edge " << edge << "\n";
+    }
   }
 }
 
@@ -257,7 +665,7 @@ void WireframeApp::mouseMoveEvent(QMouseEvent *event) {
     pitch_ = std::clamp(pitch_, -89.0f, 89.0f);
 
     updateCameraQt();
-    renderModel();
+    scheduleFrame();
   }
 }
 
@@ -269,7 +677,7 @@ void WireframeApp::wheelEvent(QWheelEvent *event) {
   cam_dist_ = std::clamp(cam_dist_, 0.1f, 150.0f);
 
   updateCameraQt();
-  renderModel();
+  scheduleFrame();
 }
 
 void WireframeApp::updateCameraQt() {
@@ -282,5 +690,4 @@ void WireframeApp::updateCameraQt() {
 
   eye = center + camDir * cam_dist_;
   view = MiniGLM::lookAt(eye, center, MiniGLM::vec3(0, 1, 0));
-  processor.setViewMatrix(view);
 }